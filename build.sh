@@ -6,6 +6,7 @@ src/harvestine/estimate_cpu_timer_freq.c
 src/harvestine/gen_harvestine.c
 src/harvestine/harvestine.c
 src/harvestine/microbenchmarks.c src/harvestine/microbenchmarks.S
+src/harvestine/parse_f64_bench.c
 src/harvestine/pf_counter.c
 src/harvestine/ptr_anatomy.c
 src/harvestine/read_overhead.c
@@ -127,7 +128,7 @@ esac
 # Linker flags
 ld_flags=
 case "$os"  in
-  linux)    ld_flags=-lm;;
+  linux)    ld_flags='-lm -lpthread';;
 esac
 
 # Disassembler util
@@ -2,7 +2,15 @@
 
 #include "types.h"
 
-#include <math.h>       // sin cos asin sqrt
+#include <math.h>       // sin cos asin sqrt sinf cosf asinf sqrtf
+
+// a * b + c must not be fused into FMA, SIMD kernels match these scalar
+// functions bit for bit. gcc doesn't contract in ISO C mode (-std=c11),
+// clang does by default. The pragma holds until the end of the translation
+// unit.
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif // #ifdef __clang__
 
 #define EARTH_RAD 6372.8
 
@@ -30,3 +38,40 @@ static inline f64 calc_harvestine(f64 x0, f64 y0, f64 x1, f64 y1,
   f64 c = 2.0 * asin(sqrt(a));
   return earth_rad * c;
 }
+
+static FORCE_INLINE f32 sqr_f32(f32 v) {
+  return v * v;
+}
+
+static FORCE_INLINE f32 deg2rad_f32(f32 deg) {
+  return 0.01745329251994329577f * deg;
+}
+
+// f32 precision. Does not meet 1 m accuracy near antipodes.
+// Measured against calc_harvestine() with --validate, not a bound:
+//   gen_harvestine 42 200000 - mean abs error 0.92 m, max 1.18 km
+//   gen_harvestine 7 1000000 - mean abs error 0.68 m, max 0.75 km
+// Max error is near antipodes, where asinf(sqrtf(a)) is ill-conditioned:
+// `a` one ULP (2^-24) below 1 moves the distance by 2 R 2^-12, about 3 km,
+// so errors of a few km are possible. Elsewhere f32 limits it too:
+// rounding coordinates moves points up to 1.2 m, ULP of distances above
+// 16384 km is 2 m.
+static inline f32 calc_harvestine_f32(f32 x0, f32 y0, f32 x1, f32 y1,
+    f32 earth_rad) {
+  f32 lat0 = y0;
+  f32 lat1 = y1;
+  f32 lon0 = x0;
+  f32 lon1 = x1;
+
+  f32 dlat = deg2rad_f32(lat1 - lat0);
+  f32 dlon = deg2rad_f32(lon1 - lon0);
+  lat0 = deg2rad_f32(lat0);
+  lat1 = deg2rad_f32(lat1);
+
+  f32 a = sqr_f32(sinf(dlat / 2.0f))
+    + cosf(lat0) * cosf(lat1) * sqr_f32(sinf(dlon / 2.0f));
+  // Near antipodes rounding pushes `a` above 1, asinf() would return NaN
+  a = a > 1.0f ? 1.0f : a;
+  f32 c = 2.0f * asinf(sqrtf(a));
+  return earth_rad * c;
+}
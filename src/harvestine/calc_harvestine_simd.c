@@ -0,0 +1,1854 @@
+#include "calc_harvestine_simd.h"
+#include "calc_harvestine.h"
+
+#include <string.h>     // memcpy strcmp
+
+#if defined(__x86_64__)
+#include <immintrin.h>  // _mm256_* _mm512_*
+#elif defined(__aarch64__)
+#include <arm_neon.h>   // v*q_f64
+#if defined(__linux__)
+#include <sys/auxv.h>   // getauxval AT_HWCAP HWCAP_ASIMD
+#endif
+#endif
+
+// Scalar helpers below are plain C, keep them unfused like intrinsics,
+// see calc_harvestine.h
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif // #ifdef __clang__
+
+// --------------------------------------
+// Constants
+// --------------------------------------
+
+enum {HV_LANES = HARVESTINE_SIMD_LANE_COUNT};
+
+// deg2rad() factor, including its rounding to f32
+#define HV_DEG2RAD      ((f64)0.01745329251994329577f)
+
+// x * 2/pi + 1.5 * 2^52 rounds to integer n, low bits of the result are n
+#define HV_TWO_OVER_PI  6.36619772367581382433e-01
+#define HV_ROUND_MAGIC  6755399441055744.0
+
+// pi/2 = PIO2_1 + PIO2_2 + PIO2_3 + PIO2_3T, first 3 parts have 33 bits, so
+// n * PIO2_i is exact for |n| < 2^20
+#define HV_PIO2_1       1.57079632673412561417e+00
+#define HV_PIO2_2       6.07710050630396597660e-11
+#define HV_PIO2_3       2.02226624871116645580e-21
+#define HV_PIO2_3T      8.47842766036889956997e-32
+
+// sin(r) = r + r^3 * S(r^2), |r| <= pi/4
+#define HV_S1           -1.66666666666666324348e-01
+#define HV_S2            8.33333333332248946124e-03
+#define HV_S3           -1.98412698298579493134e-04
+#define HV_S4            2.75573137070700676789e-06
+#define HV_S5           -2.50507602534068634195e-08
+#define HV_S6            1.58969099521155010221e-10
+
+// cos(r) = 1 - r^2 / 2 + r^4 * C(r^2), |r| <= pi/4
+#define HV_C1            4.16666666666666019037e-02
+#define HV_C2           -1.38888888888741095749e-03
+#define HV_C3            2.48015872894767294178e-05
+#define HV_C4           -2.75573143513906633035e-07
+#define HV_C5            2.08757232129817482790e-09
+#define HV_C6           -1.13596475577881948265e-11
+
+// asin(x) = x + x * P(x^2) / Q(x^2), |x| < 0.5
+#define HV_PS0           1.66666666666666657415e-01
+#define HV_PS1          -3.25565818622400915405e-01
+#define HV_PS2           2.01212532134862925881e-01
+#define HV_PS3          -4.00555345006794114027e-02
+#define HV_PS4           7.91534994289814532176e-04
+#define HV_PS5           3.47933107596021167570e-05
+#define HV_QS1          -2.40339491173441421878e+00
+#define HV_QS2           2.02094576023350569471e+00
+#define HV_QS3          -6.88283971605453293030e-01
+#define HV_QS4           7.70381505559019352791e-02
+
+// pi/2 = PIO2_HI + PIO2_LO
+#define HV_PIO2_HI       1.57079632679489655800e+00
+#define HV_PIO2_LO       6.12323399573676603587e-17
+
+// --------------------------------------
+// Scalar f64
+// --------------------------------------
+
+// Every SIMD kernel below is a lane by lane copy of these functions.
+
+// Returns r = x - n * pi/2, |r| <= pi/4. Low 2 bits of `out_n` are n mod 4.
+static FORCE_INLINE f64 hv_reduce(f64 x, u64 *out_n) {
+  f64 t = x * HV_TWO_OVER_PI + HV_ROUND_MAGIC;
+  f64 n = t - HV_ROUND_MAGIC;
+  f64 r = x - n * HV_PIO2_1;
+  r = r - n * HV_PIO2_2;
+  r = r - n * HV_PIO2_3;
+  r = r - n * HV_PIO2_3T;
+  memcpy(out_n, &t, sizeof(*out_n));
+  return r;
+}
+
+// `z` is r^2
+static FORCE_INLINE f64 hv_sin_poly(f64 r, f64 z) {
+  f64 s = HV_S1 + z * (HV_S2 + z * (HV_S3 + z * (HV_S4 + z * (HV_S5
+            + z * HV_S6))));
+  return r + z * r * s;
+}
+
+static FORCE_INLINE f64 hv_cos_poly(f64 z) {
+  f64 c = z * (HV_C1 + z * (HV_C2 + z * (HV_C3 + z * (HV_C4 + z * (HV_C5
+            + z * HV_C6)))));
+  f64 hz = 0.5 * z;
+  f64 w = 1.0 - hz;
+  return w + (((1.0 - w) - hz) + z * c);
+}
+
+// sin(x)^2
+static FORCE_INLINE f64 hv_sin2(f64 x) {
+  u64 n;
+  f64 r = hv_reduce(x, &n);
+  f64 z = r * r;
+  f64 s = n & 1 ? hv_cos_poly(z) : hv_sin_poly(r, z);
+  return s * s;
+}
+
+// cos(x), quadrant n: cos r, -sin r, -cos r, sin r
+static FORCE_INLINE f64 hv_cos(f64 x) {
+  u64 n;
+  f64 r = hv_reduce(x, &n);
+  f64 z = r * r;
+  f64 c = n & 1 ? hv_sin_poly(r, z) : hv_cos_poly(z);
+  return (n + 1) & 2 ? -c : c;
+}
+
+// asin(sqrt(a)), 0 <= a <= 1
+static FORCE_INLINE f64 hv_asin_sqrt(f64 a) {
+  f64 s = sqrt(a);
+  f64 t = (1.0 - s) * 0.5;
+  b32 big = a >= 0.25;
+  f64 z = big ? t : a;
+  f64 p = z * (HV_PS0 + z * (HV_PS1 + z * (HV_PS2 + z * (HV_PS3 + z * (HV_PS4
+            + z * HV_PS5)))));
+  f64 q = 1.0 + z * (HV_QS1 + z * (HV_QS2 + z * (HV_QS3 + z * HV_QS4)));
+  f64 w = p / q;
+  f64 st = sqrt(t);
+  return big
+    ? HV_PIO2_HI - (2.0 * (st + st * w) - HV_PIO2_LO)
+    : s + s * w;
+}
+
+static FORCE_INLINE b32 hv_in_range(f64 x) {
+  return fabs(x) <= HARVESTINE_SIMD_REDUCE_MAX;
+}
+
+// Distances of HV_LANES pairs, `stride` is f64 count between pairs
+static void hv_dists_libm(const f64 *x0, const f64 *y0, const f64 *x1,
+    const f64 *y1, u64 stride, f64 earth_rad, f64 out_dists[HV_LANES]) {
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    u64 i = l * stride;
+    out_dists[l] = calc_harvestine(x0[i], y0[i], x1[i], y1[i], earth_rad);
+  }
+}
+
+static void hv_dists_scalar(const f64 *x0, const f64 *y0, const f64 *x1,
+    const f64 *y1, u64 stride, f64 earth_rad, f64 out_dists[HV_LANES]) {
+  f64 dlat[HV_LANES];
+  f64 dlon[HV_LANES];
+  f64 lat0[HV_LANES];
+  f64 lat1[HV_LANES];
+  b32 in_range = true;
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    u64 i = l * stride;
+    dlat[l] = (y1[i] - y0[i]) * HV_DEG2RAD * 0.5;
+    dlon[l] = (x1[i] - x0[i]) * HV_DEG2RAD * 0.5;
+    lat0[l] = y0[i] * HV_DEG2RAD;
+    lat1[l] = y1[i] * HV_DEG2RAD;
+    in_range &= hv_in_range(dlat[l]) & hv_in_range(dlon[l])
+      & hv_in_range(lat0[l]) & hv_in_range(lat1[l]);
+  }
+
+  if (UNLIKELY(!in_range)) {
+    hv_dists_libm(x0, y0, x1, y1, stride, earth_rad, out_dists);
+    return;
+  }
+
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    f64 a = hv_sin2(dlat[l]) + hv_cos(lat0[l]) * hv_cos(lat1[l])
+      * hv_sin2(dlon[l]);
+    out_dists[l] = earth_rad * (2.0 * hv_asin_sqrt(a));
+  }
+}
+
+// Lanes are always added up in this order
+static FORCE_INLINE f64 hv_lanes_sum(const f64 acc[HV_LANES]) {
+  return ((acc[0] + acc[1]) + (acc[2] + acc[3]))
+    + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+// Adds block distances to lanes of `acc` and copies first `count` of them
+// to `out_dists` if it's not 0
+static FORCE_INLINE void hv_acc_dists(f64 acc[HV_LANES],
+    const f64 dists[HV_LANES], f64 *out_dists, u64 count) {
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    acc[l] += dists[l];
+  }
+  if (out_dists) {
+    memcpy(out_dists, dists, count * sizeof(f64));
+  }
+}
+
+// Copies distances of the zero padded tail block that starts at pair `i`
+static FORCE_INLINE void hv_copy_tail_dists(f64 *out_dists, u64 i,
+    u64 pair_count, const f64 tail_dists[HV_LANES]) {
+  if (out_dists) {
+    memcpy(out_dists + i, tail_dists, (pair_count - i) * sizeof(f64));
+  }
+}
+
+static f64 harvestine_sum_aos_scalar(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  f64 acc[HV_LANES] = {0};
+  f64 dists[HV_LANES];
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    const f64 *c = coords + i * 4;
+    hv_dists_scalar(c, c + 1, c + 2, c + 3, 4, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, HV_LANES);
+  }
+
+  // Tail is padded with zero pairs, their distance is +0.0
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hv_dists_scalar(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, pair_count - i);
+  }
+  return hv_lanes_sum(acc);
+}
+
+static f64 harvestine_sum_soa_scalar(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  f64 acc[HV_LANES] = {0};
+  f64 dists[HV_LANES];
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_dists_scalar(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, HV_LANES);
+  }
+
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    hv_dists_scalar(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, pair_count - i);
+  }
+  return hv_lanes_sum(acc);
+}
+
+static b32 hv_supported_always(void) {
+  return true;
+}
+
+#if defined(__x86_64__)
+
+// --------------------------------------
+// AVX2
+// --------------------------------------
+
+// 2 x 4 lanes per block
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_reduce_avx2(__m256d x, __m256i *out_n) {
+  __m256d magic = _mm256_set1_pd(HV_ROUND_MAGIC);
+  __m256d t = _mm256_add_pd(
+      _mm256_mul_pd(x, _mm256_set1_pd(HV_TWO_OVER_PI)), magic);
+  __m256d n = _mm256_sub_pd(t, magic);
+  __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(HV_PIO2_1)));
+  r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(HV_PIO2_2)));
+  r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(HV_PIO2_3)));
+  r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(HV_PIO2_3T)));
+  *out_n = _mm256_castpd_si256(t);
+  return r;
+}
+
+// a + b * c without FMA
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_madd_avx2(__m256d a, __m256d b, f64 c) {
+  return _mm256_add_pd(a, _mm256_mul_pd(b, _mm256_set1_pd(c)));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_horner_avx2(__m256d z, f64 c0, __m256d p) {
+  return _mm256_add_pd(_mm256_set1_pd(c0), _mm256_mul_pd(z, p));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_sin_poly_avx2(__m256d r, __m256d z) {
+  __m256d s = hv_madd_avx2(_mm256_set1_pd(HV_S5), z, HV_S6);
+  s = hv_horner_avx2(z, HV_S4, s);
+  s = hv_horner_avx2(z, HV_S3, s);
+  s = hv_horner_avx2(z, HV_S2, s);
+  s = hv_horner_avx2(z, HV_S1, s);
+  return _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(z, r), s));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_cos_poly_avx2(__m256d z) {
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d c = hv_madd_avx2(_mm256_set1_pd(HV_C5), z, HV_C6);
+  c = hv_horner_avx2(z, HV_C4, c);
+  c = hv_horner_avx2(z, HV_C3, c);
+  c = hv_horner_avx2(z, HV_C2, c);
+  c = hv_horner_avx2(z, HV_C1, c);
+  c = _mm256_mul_pd(z, c);
+  __m256d hz = _mm256_mul_pd(_mm256_set1_pd(0.5), z);
+  __m256d w = _mm256_sub_pd(one, hz);
+  return _mm256_add_pd(w, _mm256_add_pd(
+        _mm256_sub_pd(_mm256_sub_pd(one, w), hz), _mm256_mul_pd(z, c)));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_sin2_avx2(__m256d x) {
+  __m256i n;
+  __m256d r = hv_reduce_avx2(x, &n);
+  __m256d z = _mm256_mul_pd(r, r);
+  // blendv selects by sign bit, move quadrant bit 0 there
+  __m256d odd = _mm256_castsi256_pd(_mm256_slli_epi64(n, 63));
+  __m256d s = _mm256_blendv_pd(
+      hv_sin_poly_avx2(r, z), hv_cos_poly_avx2(z), odd);
+  return _mm256_mul_pd(s, s);
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_cos_avx2(__m256d x) {
+  __m256i n;
+  __m256d r = hv_reduce_avx2(x, &n);
+  __m256d z = _mm256_mul_pd(r, r);
+  __m256d odd = _mm256_castsi256_pd(_mm256_slli_epi64(n, 63));
+  __m256d c = _mm256_blendv_pd(
+      hv_cos_poly_avx2(z), hv_sin_poly_avx2(r, z), odd);
+  // bit 1 of n + 1 is the sign
+  __m256i sign = _mm256_slli_epi64(
+      _mm256_srli_epi64(_mm256_add_epi64(n, _mm256_set1_epi64x(1)), 1), 63);
+  return _mm256_xor_pd(c, _mm256_castsi256_pd(sign));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256d hv_asin_sqrt_avx2(__m256d a) {
+  __m256d s = _mm256_sqrt_pd(a);
+  __m256d t = _mm256_mul_pd(
+      _mm256_sub_pd(_mm256_set1_pd(1.0), s), _mm256_set1_pd(0.5));
+  __m256d big = _mm256_cmp_pd(a, _mm256_set1_pd(0.25), _CMP_GE_OQ);
+  __m256d z = _mm256_blendv_pd(a, t, big);
+  __m256d p = hv_madd_avx2(_mm256_set1_pd(HV_PS4), z, HV_PS5);
+  p = hv_horner_avx2(z, HV_PS3, p);
+  p = hv_horner_avx2(z, HV_PS2, p);
+  p = hv_horner_avx2(z, HV_PS1, p);
+  p = hv_horner_avx2(z, HV_PS0, p);
+  p = _mm256_mul_pd(z, p);
+  __m256d q = hv_madd_avx2(_mm256_set1_pd(HV_QS3), z, HV_QS4);
+  q = hv_horner_avx2(z, HV_QS2, q);
+  q = hv_horner_avx2(z, HV_QS1, q);
+  q = hv_horner_avx2(z, 1.0, q);
+  __m256d w = _mm256_div_pd(p, q);
+  __m256d st = _mm256_sqrt_pd(t);
+  __m256d res_big = _mm256_sub_pd(_mm256_set1_pd(HV_PIO2_HI),
+      _mm256_sub_pd(
+        _mm256_mul_pd(_mm256_set1_pd(2.0),
+          _mm256_add_pd(st, _mm256_mul_pd(st, w))),
+        _mm256_set1_pd(HV_PIO2_LO)));
+  __m256d res_small = _mm256_add_pd(s, _mm256_mul_pd(s, w));
+  return _mm256_blendv_pd(res_small, res_big, big);
+}
+
+// Returns false if any argument is out of range, `out_dist` is undefined then
+__attribute__((target("avx2")))
+static FORCE_INLINE b32 hv_dist_avx2(__m256d x0, __m256d y0, __m256d x1,
+    __m256d y1, f64 earth_rad, __m256d *out_dist) {
+  __m256d deg2rad = _mm256_set1_pd(HV_DEG2RAD);
+  __m256d half = _mm256_set1_pd(0.5);
+  __m256d dlat = _mm256_mul_pd(
+      _mm256_mul_pd(_mm256_sub_pd(y1, y0), deg2rad), half);
+  __m256d dlon = _mm256_mul_pd(
+      _mm256_mul_pd(_mm256_sub_pd(x1, x0), deg2rad), half);
+  __m256d lat0 = _mm256_mul_pd(y0, deg2rad);
+  __m256d lat1 = _mm256_mul_pd(y1, deg2rad);
+
+  __m256d abs_mask = _mm256_castsi256_pd(
+      _mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  __m256d max = _mm256_set1_pd(HARVESTINE_SIMD_REDUCE_MAX);
+  __m256d in_range = _mm256_and_pd(
+      _mm256_and_pd(
+        _mm256_cmp_pd(_mm256_and_pd(dlat, abs_mask), max, _CMP_LE_OQ),
+        _mm256_cmp_pd(_mm256_and_pd(dlon, abs_mask), max, _CMP_LE_OQ)),
+      _mm256_and_pd(
+        _mm256_cmp_pd(_mm256_and_pd(lat0, abs_mask), max, _CMP_LE_OQ),
+        _mm256_cmp_pd(_mm256_and_pd(lat1, abs_mask), max, _CMP_LE_OQ)));
+  if (UNLIKELY(_mm256_movemask_pd(in_range) != 0xF)) {
+    return false;
+  }
+
+  __m256d a = _mm256_add_pd(hv_sin2_avx2(dlat),
+      _mm256_mul_pd(
+        _mm256_mul_pd(hv_cos_avx2(lat0), hv_cos_avx2(lat1)),
+        hv_sin2_avx2(dlon)));
+  __m256d c = _mm256_mul_pd(_mm256_set1_pd(2.0), hv_asin_sqrt_avx2(a));
+  *out_dist = _mm256_mul_pd(_mm256_set1_pd(earth_rad), c);
+  return true;
+}
+
+// 4 records x0 y0 x1 y1 -> x0[4] y0[4] x1[4] y1[4]
+__attribute__((target("avx2")))
+static FORCE_INLINE void hv_load_aos_avx2(const f64 *coords,
+    __m256d *x0, __m256d *y0, __m256d *x1, __m256d *y1) {
+  __m256d r0 = _mm256_loadu_pd(coords + 0);
+  __m256d r1 = _mm256_loadu_pd(coords + 4);
+  __m256d r2 = _mm256_loadu_pd(coords + 8);
+  __m256d r3 = _mm256_loadu_pd(coords + 12);
+  __m256d t0 = _mm256_unpacklo_pd(r0, r1); // x0 x0 x1 x1
+  __m256d t1 = _mm256_unpackhi_pd(r0, r1); // y0 y0 y1 y1
+  __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+  __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+  *x0 = _mm256_permute2f128_pd(t0, t2, 0x20);
+  *x1 = _mm256_permute2f128_pd(t0, t2, 0x31);
+  *y0 = _mm256_permute2f128_pd(t1, t3, 0x20);
+  *y1 = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+// Adds distances of HV_LANES pairs to `acc`, stores them to `out_dists` if
+// it's not 0
+__attribute__((target("avx2")))
+static FORCE_INLINE void hv_block_aos_avx2(const f64 *coords, f64 earth_rad,
+    __m256d acc[2], f64 *out_dists) {
+  __m256d x0[2], y0[2], x1[2], y1[2], dist[2];
+  hv_load_aos_avx2(coords,      x0 + 0, y0 + 0, x1 + 0, y1 + 0);
+  hv_load_aos_avx2(coords + 16, x0 + 1, y0 + 1, x1 + 1, y1 + 1);
+  if (UNLIKELY(
+        !hv_dist_avx2(x0[0], y0[0], x1[0], y1[0], earth_rad, dist + 0)
+        || !hv_dist_avx2(x0[1], y0[1], x1[1], y1[1], earth_rad, dist + 1))) {
+    f64 dists[HV_LANES];
+    hv_dists_libm(coords, coords + 1, coords + 2, coords + 3, 4, earth_rad,
+        dists);
+    dist[0] = _mm256_loadu_pd(dists);
+    dist[1] = _mm256_loadu_pd(dists + 4);
+  }
+  acc[0] = _mm256_add_pd(acc[0], dist[0]);
+  acc[1] = _mm256_add_pd(acc[1], dist[1]);
+  if (out_dists) {
+    _mm256_storeu_pd(out_dists, dist[0]);
+    _mm256_storeu_pd(out_dists + 4, dist[1]);
+  }
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE void hv_block_soa_avx2(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, f64 earth_rad, __m256d acc[2],
+    f64 *out_dists) {
+  __m256d dist[2];
+  if (UNLIKELY(
+        !hv_dist_avx2(_mm256_loadu_pd(x0), _mm256_loadu_pd(y0),
+          _mm256_loadu_pd(x1), _mm256_loadu_pd(y1), earth_rad, dist + 0)
+        || !hv_dist_avx2(_mm256_loadu_pd(x0 + 4), _mm256_loadu_pd(y0 + 4),
+          _mm256_loadu_pd(x1 + 4), _mm256_loadu_pd(y1 + 4), earth_rad,
+          dist + 1))) {
+    f64 dists[HV_LANES];
+    hv_dists_libm(x0, y0, x1, y1, 1, earth_rad, dists);
+    dist[0] = _mm256_loadu_pd(dists);
+    dist[1] = _mm256_loadu_pd(dists + 4);
+  }
+  acc[0] = _mm256_add_pd(acc[0], dist[0]);
+  acc[1] = _mm256_add_pd(acc[1], dist[1]);
+  if (out_dists) {
+    _mm256_storeu_pd(out_dists, dist[0]);
+    _mm256_storeu_pd(out_dists + 4, dist[1]);
+  }
+}
+
+__attribute__((target("avx2")))
+static f64 hv_acc_sum_avx2(const __m256d acc[2]) {
+  f64 lanes[HV_LANES];
+  _mm256_storeu_pd(lanes, acc[0]);
+  _mm256_storeu_pd(lanes + 4, acc[1]);
+  return hv_lanes_sum(lanes);
+}
+
+__attribute__((target("avx2")))
+static f64 harvestine_sum_aos_avx2(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  __m256d acc[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_block_aos_avx2(coords + i * 4, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    f64 tail_dists[HV_LANES];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hv_block_aos_avx2(tail, earth_rad, acc, tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx2(acc);
+}
+
+__attribute__((target("avx2")))
+static f64 harvestine_sum_soa_avx2(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  __m256d acc[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_block_soa_avx2(x0 + i, y0 + i, x1 + i, y1 + i, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    f64 tail_dists[HV_LANES];
+    hv_block_soa_avx2(tail[0], tail[1], tail[2], tail[3], earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx2(acc);
+}
+
+static b32 hv_supported_avx2(void) {
+  return __builtin_cpu_supports("avx2");
+}
+
+// --------------------------------------
+// AVX-512
+// --------------------------------------
+
+// 8 lanes per block
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_reduce_avx512(__m512d x, __m512i *out_n) {
+  __m512d magic = _mm512_set1_pd(HV_ROUND_MAGIC);
+  __m512d t = _mm512_add_pd(
+      _mm512_mul_pd(x, _mm512_set1_pd(HV_TWO_OVER_PI)), magic);
+  __m512d n = _mm512_sub_pd(t, magic);
+  __m512d r = _mm512_sub_pd(x, _mm512_mul_pd(n, _mm512_set1_pd(HV_PIO2_1)));
+  r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(HV_PIO2_2)));
+  r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(HV_PIO2_3)));
+  r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(HV_PIO2_3T)));
+  *out_n = _mm512_castpd_si512(t);
+  return r;
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_madd_avx512(__m512d a, __m512d b, f64 c) {
+  return _mm512_add_pd(a, _mm512_mul_pd(b, _mm512_set1_pd(c)));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_horner_avx512(__m512d z, f64 c0, __m512d p) {
+  return _mm512_add_pd(_mm512_set1_pd(c0), _mm512_mul_pd(z, p));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_sin_poly_avx512(__m512d r, __m512d z) {
+  __m512d s = hv_madd_avx512(_mm512_set1_pd(HV_S5), z, HV_S6);
+  s = hv_horner_avx512(z, HV_S4, s);
+  s = hv_horner_avx512(z, HV_S3, s);
+  s = hv_horner_avx512(z, HV_S2, s);
+  s = hv_horner_avx512(z, HV_S1, s);
+  return _mm512_add_pd(r, _mm512_mul_pd(_mm512_mul_pd(z, r), s));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_cos_poly_avx512(__m512d z) {
+  __m512d one = _mm512_set1_pd(1.0);
+  __m512d c = hv_madd_avx512(_mm512_set1_pd(HV_C5), z, HV_C6);
+  c = hv_horner_avx512(z, HV_C4, c);
+  c = hv_horner_avx512(z, HV_C3, c);
+  c = hv_horner_avx512(z, HV_C2, c);
+  c = hv_horner_avx512(z, HV_C1, c);
+  c = _mm512_mul_pd(z, c);
+  __m512d hz = _mm512_mul_pd(_mm512_set1_pd(0.5), z);
+  __m512d w = _mm512_sub_pd(one, hz);
+  return _mm512_add_pd(w, _mm512_add_pd(
+        _mm512_sub_pd(_mm512_sub_pd(one, w), hz), _mm512_mul_pd(z, c)));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_sin2_avx512(__m512d x) {
+  __m512i n;
+  __m512d r = hv_reduce_avx512(x, &n);
+  __m512d z = _mm512_mul_pd(r, r);
+  __mmask8 odd = _mm512_test_epi64_mask(n, _mm512_set1_epi64(1));
+  __m512d s = _mm512_mask_blend_pd(odd,
+      hv_sin_poly_avx512(r, z), hv_cos_poly_avx512(z));
+  return _mm512_mul_pd(s, s);
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_cos_avx512(__m512d x) {
+  __m512i n;
+  __m512d r = hv_reduce_avx512(x, &n);
+  __m512d z = _mm512_mul_pd(r, r);
+  __mmask8 odd = _mm512_test_epi64_mask(n, _mm512_set1_epi64(1));
+  __m512d c = _mm512_mask_blend_pd(odd,
+      hv_cos_poly_avx512(z), hv_sin_poly_avx512(r, z));
+  __m512i sign = _mm512_slli_epi64(
+      _mm512_srli_epi64(_mm512_add_epi64(n, _mm512_set1_epi64(1)), 1), 63);
+  return _mm512_castsi512_pd(
+      _mm512_xor_si512(_mm512_castpd_si512(c), sign));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512d hv_asin_sqrt_avx512(__m512d a) {
+  __m512d s = _mm512_sqrt_pd(a);
+  __m512d t = _mm512_mul_pd(
+      _mm512_sub_pd(_mm512_set1_pd(1.0), s), _mm512_set1_pd(0.5));
+  __mmask8 big = _mm512_cmp_pd_mask(a, _mm512_set1_pd(0.25), _CMP_GE_OQ);
+  __m512d z = _mm512_mask_blend_pd(big, a, t);
+  __m512d p = hv_madd_avx512(_mm512_set1_pd(HV_PS4), z, HV_PS5);
+  p = hv_horner_avx512(z, HV_PS3, p);
+  p = hv_horner_avx512(z, HV_PS2, p);
+  p = hv_horner_avx512(z, HV_PS1, p);
+  p = hv_horner_avx512(z, HV_PS0, p);
+  p = _mm512_mul_pd(z, p);
+  __m512d q = hv_madd_avx512(_mm512_set1_pd(HV_QS3), z, HV_QS4);
+  q = hv_horner_avx512(z, HV_QS2, q);
+  q = hv_horner_avx512(z, HV_QS1, q);
+  q = hv_horner_avx512(z, 1.0, q);
+  __m512d w = _mm512_div_pd(p, q);
+  __m512d st = _mm512_sqrt_pd(t);
+  __m512d res_big = _mm512_sub_pd(_mm512_set1_pd(HV_PIO2_HI),
+      _mm512_sub_pd(
+        _mm512_mul_pd(_mm512_set1_pd(2.0),
+          _mm512_add_pd(st, _mm512_mul_pd(st, w))),
+        _mm512_set1_pd(HV_PIO2_LO)));
+  __m512d res_small = _mm512_add_pd(s, _mm512_mul_pd(s, w));
+  return _mm512_mask_blend_pd(big, res_small, res_big);
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE b32 hv_dist_avx512(__m512d x0, __m512d y0, __m512d x1,
+    __m512d y1, f64 earth_rad, __m512d *out_dist) {
+  __m512d deg2rad = _mm512_set1_pd(HV_DEG2RAD);
+  __m512d half = _mm512_set1_pd(0.5);
+  __m512d dlat = _mm512_mul_pd(
+      _mm512_mul_pd(_mm512_sub_pd(y1, y0), deg2rad), half);
+  __m512d dlon = _mm512_mul_pd(
+      _mm512_mul_pd(_mm512_sub_pd(x1, x0), deg2rad), half);
+  __m512d lat0 = _mm512_mul_pd(y0, deg2rad);
+  __m512d lat1 = _mm512_mul_pd(y1, deg2rad);
+
+  __m512d max = _mm512_set1_pd(HARVESTINE_SIMD_REDUCE_MAX);
+  __mmask8 in_range =
+    _mm512_cmp_pd_mask(_mm512_abs_pd(dlat), max, _CMP_LE_OQ)
+    & _mm512_cmp_pd_mask(_mm512_abs_pd(dlon), max, _CMP_LE_OQ)
+    & _mm512_cmp_pd_mask(_mm512_abs_pd(lat0), max, _CMP_LE_OQ)
+    & _mm512_cmp_pd_mask(_mm512_abs_pd(lat1), max, _CMP_LE_OQ);
+  if (UNLIKELY(in_range != 0xFF)) {
+    return false;
+  }
+
+  __m512d a = _mm512_add_pd(hv_sin2_avx512(dlat),
+      _mm512_mul_pd(
+        _mm512_mul_pd(hv_cos_avx512(lat0), hv_cos_avx512(lat1)),
+        hv_sin2_avx512(dlon)));
+  __m512d c = _mm512_mul_pd(_mm512_set1_pd(2.0), hv_asin_sqrt_avx512(a));
+  *out_dist = _mm512_mul_pd(_mm512_set1_pd(earth_rad), c);
+  return true;
+}
+
+// 8 records x0 y0 x1 y1 -> x0[8] y0[8] x1[8] y1[8] in two steps:
+// records 4 apart -> 4 x 2 columns of 4 -> 4 columns of 8
+__attribute__((target("avx512f")))
+static FORCE_INLINE void hv_load_aos_avx512(const f64 *coords,
+    __m512d *x0, __m512d *y0, __m512d *x1, __m512d *y1) {
+  const __m512i lo = _mm512_setr_epi64(0, 4, 8, 12, 1, 5, 9, 13);
+  const __m512i hi = _mm512_setr_epi64(2, 6, 10, 14, 3, 7, 11, 15);
+  const __m512i col_lo = _mm512_setr_epi64(0, 1, 2, 3, 8, 9, 10, 11);
+  const __m512i col_hi = _mm512_setr_epi64(4, 5, 6, 7, 12, 13, 14, 15);
+  __m512d r0 = _mm512_loadu_pd(coords + 0);
+  __m512d r1 = _mm512_loadu_pd(coords + 8);
+  __m512d r2 = _mm512_loadu_pd(coords + 16);
+  __m512d r3 = _mm512_loadu_pd(coords + 24);
+  __m512d xy0_a = _mm512_permutex2var_pd(r0, lo, r1); // x0[0:4] y0[0:4]
+  __m512d xy1_a = _mm512_permutex2var_pd(r0, hi, r1); // x1[0:4] y1[0:4]
+  __m512d xy0_b = _mm512_permutex2var_pd(r2, lo, r3); // x0[4:8] y0[4:8]
+  __m512d xy1_b = _mm512_permutex2var_pd(r2, hi, r3); // x1[4:8] y1[4:8]
+  *x0 = _mm512_permutex2var_pd(xy0_a, col_lo, xy0_b);
+  *y0 = _mm512_permutex2var_pd(xy0_a, col_hi, xy0_b);
+  *x1 = _mm512_permutex2var_pd(xy1_a, col_lo, xy1_b);
+  *y1 = _mm512_permutex2var_pd(xy1_a, col_hi, xy1_b);
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE void hv_block_aos_avx512(const f64 *coords,
+    f64 earth_rad, __m512d *acc, f64 *out_dists) {
+  __m512d x0, y0, x1, y1;
+  hv_load_aos_avx512(coords, &x0, &y0, &x1, &y1);
+
+  __m512d dist;
+  if (UNLIKELY(!hv_dist_avx512(x0, y0, x1, y1, earth_rad, &dist))) {
+    f64 dists[HV_LANES];
+    hv_dists_libm(coords, coords + 1, coords + 2, coords + 3, 4, earth_rad,
+        dists);
+    dist = _mm512_loadu_pd(dists);
+  }
+  *acc = _mm512_add_pd(*acc, dist);
+  if (out_dists) {
+    _mm512_storeu_pd(out_dists, dist);
+  }
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE void hv_block_soa_avx512(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, f64 earth_rad, __m512d *acc,
+    f64 *out_dists) {
+  __m512d dist;
+  if (UNLIKELY(!hv_dist_avx512(_mm512_loadu_pd(x0), _mm512_loadu_pd(y0),
+          _mm512_loadu_pd(x1), _mm512_loadu_pd(y1), earth_rad, &dist))) {
+    f64 dists[HV_LANES];
+    hv_dists_libm(x0, y0, x1, y1, 1, earth_rad, dists);
+    dist = _mm512_loadu_pd(dists);
+  }
+  *acc = _mm512_add_pd(*acc, dist);
+  if (out_dists) {
+    _mm512_storeu_pd(out_dists, dist);
+  }
+}
+
+__attribute__((target("avx512f")))
+static f64 hv_acc_sum_avx512(__m512d acc) {
+  f64 lanes[HV_LANES];
+  _mm512_storeu_pd(lanes, acc);
+  return hv_lanes_sum(lanes);
+}
+
+__attribute__((target("avx512f")))
+static f64 harvestine_sum_aos_avx512(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  __m512d acc = _mm512_setzero_pd();
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_block_aos_avx512(coords + i * 4, earth_rad, &acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    f64 tail_dists[HV_LANES];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hv_block_aos_avx512(tail, earth_rad, &acc, tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx512(acc);
+}
+
+__attribute__((target("avx512f")))
+static f64 harvestine_sum_soa_avx512(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  __m512d acc = _mm512_setzero_pd();
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_block_soa_avx512(x0 + i, y0 + i, x1 + i, y1 + i, earth_rad, &acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    f64 tail_dists[HV_LANES];
+    hv_block_soa_avx512(tail[0], tail[1], tail[2], tail[3], earth_rad, &acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx512(acc);
+}
+
+static b32 hv_supported_avx512(void) {
+  return __builtin_cpu_supports("avx512f");
+}
+
+#elif defined(__aarch64__)
+
+// --------------------------------------
+// NEON
+// --------------------------------------
+
+// 4 x 2 lanes per block
+
+static FORCE_INLINE float64x2_t hv_reduce_neon(float64x2_t x,
+    uint64x2_t *out_n) {
+  float64x2_t magic = vdupq_n_f64(HV_ROUND_MAGIC);
+  float64x2_t t = vaddq_f64(vmulq_f64(x, vdupq_n_f64(HV_TWO_OVER_PI)), magic);
+  float64x2_t n = vsubq_f64(t, magic);
+  float64x2_t r = vsubq_f64(x, vmulq_f64(n, vdupq_n_f64(HV_PIO2_1)));
+  r = vsubq_f64(r, vmulq_f64(n, vdupq_n_f64(HV_PIO2_2)));
+  r = vsubq_f64(r, vmulq_f64(n, vdupq_n_f64(HV_PIO2_3)));
+  r = vsubq_f64(r, vmulq_f64(n, vdupq_n_f64(HV_PIO2_3T)));
+  *out_n = vreinterpretq_u64_f64(t);
+  return r;
+}
+
+// NOTE: vmlaq_f64 might be fused, keep multiply and add separate
+static FORCE_INLINE float64x2_t hv_madd_neon(float64x2_t a, float64x2_t b,
+    f64 c) {
+  return vaddq_f64(a, vmulq_f64(b, vdupq_n_f64(c)));
+}
+
+static FORCE_INLINE float64x2_t hv_horner_neon(float64x2_t z, f64 c0,
+    float64x2_t p) {
+  return vaddq_f64(vdupq_n_f64(c0), vmulq_f64(z, p));
+}
+
+static FORCE_INLINE float64x2_t hv_sin_poly_neon(float64x2_t r,
+    float64x2_t z) {
+  float64x2_t s = hv_madd_neon(vdupq_n_f64(HV_S5), z, HV_S6);
+  s = hv_horner_neon(z, HV_S4, s);
+  s = hv_horner_neon(z, HV_S3, s);
+  s = hv_horner_neon(z, HV_S2, s);
+  s = hv_horner_neon(z, HV_S1, s);
+  return vaddq_f64(r, vmulq_f64(vmulq_f64(z, r), s));
+}
+
+static FORCE_INLINE float64x2_t hv_cos_poly_neon(float64x2_t z) {
+  float64x2_t one = vdupq_n_f64(1.0);
+  float64x2_t c = hv_madd_neon(vdupq_n_f64(HV_C5), z, HV_C6);
+  c = hv_horner_neon(z, HV_C4, c);
+  c = hv_horner_neon(z, HV_C3, c);
+  c = hv_horner_neon(z, HV_C2, c);
+  c = hv_horner_neon(z, HV_C1, c);
+  c = vmulq_f64(z, c);
+  float64x2_t hz = vmulq_f64(vdupq_n_f64(0.5), z);
+  float64x2_t w = vsubq_f64(one, hz);
+  return vaddq_f64(w, vaddq_f64(
+        vsubq_f64(vsubq_f64(one, w), hz), vmulq_f64(z, c)));
+}
+
+static FORCE_INLINE float64x2_t hv_sin2_neon(float64x2_t x) {
+  uint64x2_t n;
+  float64x2_t r = hv_reduce_neon(x, &n);
+  float64x2_t z = vmulq_f64(r, r);
+  uint64x2_t odd = vtstq_u64(n, vdupq_n_u64(1));
+  float64x2_t s = vbslq_f64(odd, hv_cos_poly_neon(z), hv_sin_poly_neon(r, z));
+  return vmulq_f64(s, s);
+}
+
+static FORCE_INLINE float64x2_t hv_cos_neon(float64x2_t x) {
+  uint64x2_t n;
+  float64x2_t r = hv_reduce_neon(x, &n);
+  float64x2_t z = vmulq_f64(r, r);
+  uint64x2_t odd = vtstq_u64(n, vdupq_n_u64(1));
+  float64x2_t c = vbslq_f64(odd, hv_sin_poly_neon(r, z), hv_cos_poly_neon(z));
+  uint64x2_t sign = vshlq_n_u64(
+      vshrq_n_u64(vaddq_u64(n, vdupq_n_u64(1)), 1), 63);
+  return vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(c), sign));
+}
+
+static FORCE_INLINE float64x2_t hv_asin_sqrt_neon(float64x2_t a) {
+  float64x2_t s = vsqrtq_f64(a);
+  float64x2_t t = vmulq_f64(vsubq_f64(vdupq_n_f64(1.0), s), vdupq_n_f64(0.5));
+  uint64x2_t big = vcgeq_f64(a, vdupq_n_f64(0.25));
+  float64x2_t z = vbslq_f64(big, t, a);
+  float64x2_t p = hv_madd_neon(vdupq_n_f64(HV_PS4), z, HV_PS5);
+  p = hv_horner_neon(z, HV_PS3, p);
+  p = hv_horner_neon(z, HV_PS2, p);
+  p = hv_horner_neon(z, HV_PS1, p);
+  p = hv_horner_neon(z, HV_PS0, p);
+  p = vmulq_f64(z, p);
+  float64x2_t q = hv_madd_neon(vdupq_n_f64(HV_QS3), z, HV_QS4);
+  q = hv_horner_neon(z, HV_QS2, q);
+  q = hv_horner_neon(z, HV_QS1, q);
+  q = hv_horner_neon(z, 1.0, q);
+  float64x2_t w = vdivq_f64(p, q);
+  float64x2_t st = vsqrtq_f64(t);
+  float64x2_t res_big = vsubq_f64(vdupq_n_f64(HV_PIO2_HI),
+      vsubq_f64(
+        vmulq_f64(vdupq_n_f64(2.0), vaddq_f64(st, vmulq_f64(st, w))),
+        vdupq_n_f64(HV_PIO2_LO)));
+  float64x2_t res_small = vaddq_f64(s, vmulq_f64(s, w));
+  return vbslq_f64(big, res_big, res_small);
+}
+
+static FORCE_INLINE b32 hv_dist_neon(float64x2_t x0, float64x2_t y0,
+    float64x2_t x1, float64x2_t y1, f64 earth_rad, float64x2_t *out_dist) {
+  float64x2_t deg2rad = vdupq_n_f64(HV_DEG2RAD);
+  float64x2_t half = vdupq_n_f64(0.5);
+  float64x2_t dlat = vmulq_f64(vmulq_f64(vsubq_f64(y1, y0), deg2rad), half);
+  float64x2_t dlon = vmulq_f64(vmulq_f64(vsubq_f64(x1, x0), deg2rad), half);
+  float64x2_t lat0 = vmulq_f64(y0, deg2rad);
+  float64x2_t lat1 = vmulq_f64(y1, deg2rad);
+
+  float64x2_t max = vdupq_n_f64(HARVESTINE_SIMD_REDUCE_MAX);
+  uint64x2_t in_range = vandq_u64(
+      vandq_u64(vcaleq_f64(dlat, max), vcaleq_f64(dlon, max)),
+      vandq_u64(vcaleq_f64(lat0, max), vcaleq_f64(lat1, max)));
+  if (UNLIKELY(vminvq_u32(vreinterpretq_u32_u64(in_range)) == 0)) {
+    return false;
+  }
+
+  float64x2_t a = vaddq_f64(hv_sin2_neon(dlat),
+      vmulq_f64(vmulq_f64(hv_cos_neon(lat0), hv_cos_neon(lat1)),
+        hv_sin2_neon(dlon)));
+  float64x2_t c = vmulq_f64(vdupq_n_f64(2.0), hv_asin_sqrt_neon(a));
+  *out_dist = vmulq_f64(vdupq_n_f64(earth_rad), c);
+  return true;
+}
+
+// `x0` ... `y1` point to the first pair of the block, `stride` is 1 or 4.
+// AoS records are deinterleaved by vld4q_f64.
+static FORCE_INLINE void hv_block_neon(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 stride, f64 earth_rad,
+    float64x2_t acc[4], f64 *out_dists) {
+  float64x2_t dist[4];
+  b32 in_range = true;
+  for (u64 k = 0; k < 4; ++k) {
+    u64 i = k * 2 * stride;
+    float64x2_t vx0, vy0, vx1, vy1;
+    if (stride == 4) {
+      float64x2x4_t v = vld4q_f64(x0 + i);
+      vx0 = v.val[0];
+      vy0 = v.val[1];
+      vx1 = v.val[2];
+      vy1 = v.val[3];
+    } else {
+      vx0 = vld1q_f64(x0 + i);
+      vy0 = vld1q_f64(y0 + i);
+      vx1 = vld1q_f64(x1 + i);
+      vy1 = vld1q_f64(y1 + i);
+    }
+    in_range &= hv_dist_neon(vx0, vy0, vx1, vy1, earth_rad, dist + k);
+  }
+
+  if (UNLIKELY(!in_range)) {
+    f64 dists[HV_LANES];
+    hv_dists_libm(x0, y0, x1, y1, stride, earth_rad, dists);
+    for (u64 k = 0; k < 4; ++k) {
+      dist[k] = vld1q_f64(dists + k * 2);
+    }
+  }
+  for (u64 k = 0; k < 4; ++k) {
+    acc[k] = vaddq_f64(acc[k], dist[k]);
+    if (out_dists) {
+      vst1q_f64(out_dists + k * 2, dist[k]);
+    }
+  }
+}
+
+static f64 hv_acc_sum_neon(const float64x2_t acc[4]) {
+  f64 lanes[HV_LANES];
+  for (u64 k = 0; k < 4; ++k) {
+    vst1q_f64(lanes + k * 2, acc[k]);
+  }
+  return hv_lanes_sum(lanes);
+}
+
+static f64 harvestine_sum_aos_neon(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  float64x2_t acc[4] = {0};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    const f64 *c = coords + i * 4;
+    hv_block_neon(c, c + 1, c + 2, c + 3, 4, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    f64 tail_dists[HV_LANES];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hv_block_neon(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_neon(acc);
+}
+
+static f64 harvestine_sum_soa_neon(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  float64x2_t acc[4] = {0};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hv_block_neon(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    f64 tail_dists[HV_LANES];
+    hv_block_neon(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_neon(acc);
+}
+
+static b32 hv_supported_neon(void) {
+#if defined(__linux__)
+  return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#else
+  // Advanced SIMD is mandatory on AArch64
+  return true;
+#endif
+}
+
+#endif // #if defined(__x86_64__) #elif defined(__aarch64__)
+
+// --------------------------------------
+// f32
+// --------------------------------------
+
+// Coordinates are rounded to f32 on load and distances are calculated in f32,
+// with the same numbers as if coordinates were stored as f32.
+// Distances are summed in f64 lanes, the same way as f64 kernels do.
+// Polynomials and reduction constants are from Cephes sinf.c and asinf.c.
+
+#define HVF_DEG2RAD     0.01745329251994329577f
+#define HVF_TWO_OVER_PI 6.36619772367581343076e-01f
+#define HVF_ROUND_MAGIC 12582912.0f // 1.5 * 2^23
+
+// pi/2 = PIO2_1 + PIO2_2 + PIO2_3, n * PIO2_i is exact for
+// |n| < HVF_REDUCE_MAX * 2/pi
+#define HVF_PIO2_1      1.5703125f
+#define HVF_PIO2_2      4.837512969970703125e-4f
+#define HVF_PIO2_3      7.54978995489188216e-8f
+#define HVF_REDUCE_MAX  4096.0f
+
+#define HVF_S1          -1.6666654611e-1f
+#define HVF_S2           8.3321608736e-3f
+#define HVF_S3          -1.9515295891e-4f
+
+#define HVF_C1           4.166664568298827e-2f
+#define HVF_C2          -1.388731625493765e-3f
+#define HVF_C3           2.443315711809948e-5f
+
+// asin(x) = x + x^3 * AS(x^2), |x| <= 0.5
+#define HVF_AS0          1.6666752422e-1f
+#define HVF_AS1          7.4953002686e-2f
+#define HVF_AS2          4.5470025998e-2f
+#define HVF_AS3          2.4181311049e-2f
+#define HVF_AS4          4.2163199048e-2f
+
+#define HVF_PIO2         1.5707963267948966192f
+
+static FORCE_INLINE f32 hvf_reduce(f32 x, u32 *out_n) {
+  f32 t = x * HVF_TWO_OVER_PI + HVF_ROUND_MAGIC;
+  f32 n = t - HVF_ROUND_MAGIC;
+  f32 r = x - n * HVF_PIO2_1;
+  r = r - n * HVF_PIO2_2;
+  r = r - n * HVF_PIO2_3;
+  memcpy(out_n, &t, sizeof(*out_n));
+  return r;
+}
+
+static FORCE_INLINE f32 hvf_sin_poly(f32 r, f32 z) {
+  f32 s = HVF_S1 + z * (HVF_S2 + z * HVF_S3);
+  return r + z * r * s;
+}
+
+static FORCE_INLINE f32 hvf_cos_poly(f32 z) {
+  f32 c = HVF_C1 + z * (HVF_C2 + z * HVF_C3);
+  return (z * z * c - 0.5f * z) + 1.0f;
+}
+
+static FORCE_INLINE f32 hvf_sin2(f32 x) {
+  u32 n;
+  f32 r = hvf_reduce(x, &n);
+  f32 z = r * r;
+  f32 s = n & 1 ? hvf_cos_poly(z) : hvf_sin_poly(r, z);
+  return s * s;
+}
+
+static FORCE_INLINE f32 hvf_cos(f32 x) {
+  u32 n;
+  f32 r = hvf_reduce(x, &n);
+  f32 z = r * r;
+  f32 c = n & 1 ? hvf_sin_poly(r, z) : hvf_cos_poly(z);
+  return (n + 1) & 2 ? -c : c;
+}
+
+// asin(sqrt(a)), 0 <= a, `a` above 1 is clamped like in
+// calc_harvestine_f32()
+static FORCE_INLINE f32 hvf_asin_sqrt(f32 a) {
+  a = a > 1.0f ? 1.0f : a;
+  f32 s = sqrtf(a);
+  b32 big = a > 0.25f;
+  f32 z = big ? (1.0f - s) * 0.5f : a;
+  f32 x = big ? sqrtf(z) : s;
+  f32 p = HVF_AS0 + z * (HVF_AS1 + z * (HVF_AS2 + z * (HVF_AS3
+          + z * HVF_AS4)));
+  p = x + p * z * x;
+  return big ? HVF_PIO2 - (p + p) : p;
+}
+
+static FORCE_INLINE b32 hvf_in_range(f32 x) {
+  return fabsf(x) <= HVF_REDUCE_MAX;
+}
+
+static void hvf_dists_libm(const f64 *x0, const f64 *y0, const f64 *x1,
+    const f64 *y1, u64 stride, f64 earth_rad, f64 out_dists[HV_LANES]) {
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    u64 i = l * stride;
+    out_dists[l] = calc_harvestine_f32(x0[i], y0[i], x1[i], y1[i],
+        earth_rad);
+  }
+}
+
+static void hvf_dists_scalar(const f64 *x0, const f64 *y0, const f64 *x1,
+    const f64 *y1, u64 stride, f64 earth_rad, f64 out_dists[HV_LANES]) {
+  f32 dlat[HV_LANES];
+  f32 dlon[HV_LANES];
+  f32 lat0[HV_LANES];
+  f32 lat1[HV_LANES];
+  b32 in_range = true;
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    u64 i = l * stride;
+    f32 fy0 = y0[i];
+    f32 fy1 = y1[i];
+    dlat[l] = (fy1 - fy0) * HVF_DEG2RAD * 0.5f;
+    dlon[l] = ((f32)x1[i] - (f32)x0[i]) * HVF_DEG2RAD * 0.5f;
+    lat0[l] = fy0 * HVF_DEG2RAD;
+    lat1[l] = fy1 * HVF_DEG2RAD;
+    in_range &= hvf_in_range(dlat[l]) & hvf_in_range(dlon[l])
+      & hvf_in_range(lat0[l]) & hvf_in_range(lat1[l]);
+  }
+
+  if (UNLIKELY(!in_range)) {
+    hvf_dists_libm(x0, y0, x1, y1, stride, earth_rad, out_dists);
+    return;
+  }
+
+  f32 rad = earth_rad;
+  for (u64 l = 0; l < HV_LANES; ++l) {
+    f32 a = hvf_sin2(dlat[l]) + hvf_cos(lat0[l]) * hvf_cos(lat1[l])
+      * hvf_sin2(dlon[l]);
+    out_dists[l] = rad * (2.0f * hvf_asin_sqrt(a));
+  }
+}
+
+static f64 harvestine_sum_aos_f32_scalar(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  f64 acc[HV_LANES] = {0};
+  f64 dists[HV_LANES];
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    const f64 *c = coords + i * 4;
+    hvf_dists_scalar(c, c + 1, c + 2, c + 3, 4, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, HV_LANES);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hvf_dists_scalar(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, pair_count - i);
+  }
+  return hv_lanes_sum(acc);
+}
+
+static f64 harvestine_sum_soa_f32_scalar(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  f64 acc[HV_LANES] = {0};
+  f64 dists[HV_LANES];
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hvf_dists_scalar(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, HV_LANES);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    hvf_dists_scalar(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, dists);
+    hv_acc_dists(acc, dists, out_dists ? out_dists + i : 0, pair_count - i);
+  }
+  return hv_lanes_sum(acc);
+}
+
+#if defined(__x86_64__)
+
+// AVX2: 8 lanes per block
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_reduce_avx2(__m256 x, __m256i *out_n) {
+  __m256 magic = _mm256_set1_ps(HVF_ROUND_MAGIC);
+  __m256 t = _mm256_add_ps(
+      _mm256_mul_ps(x, _mm256_set1_ps(HVF_TWO_OVER_PI)), magic);
+  __m256 n = _mm256_sub_ps(t, magic);
+  __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(HVF_PIO2_1)));
+  r = _mm256_sub_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(HVF_PIO2_2)));
+  r = _mm256_sub_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(HVF_PIO2_3)));
+  *out_n = _mm256_castps_si256(t);
+  return r;
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_horner_avx2(__m256 z, f32 c0, __m256 p) {
+  return _mm256_add_ps(_mm256_set1_ps(c0), _mm256_mul_ps(z, p));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_sin_poly_avx2(__m256 r, __m256 z) {
+  __m256 s = hvf_horner_avx2(z, HVF_S2, _mm256_set1_ps(HVF_S3));
+  s = hvf_horner_avx2(z, HVF_S1, s);
+  return _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(z, r), s));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_cos_poly_avx2(__m256 z) {
+  __m256 c = hvf_horner_avx2(z, HVF_C2, _mm256_set1_ps(HVF_C3));
+  c = hvf_horner_avx2(z, HVF_C1, c);
+  return _mm256_add_ps(
+      _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(z, z), c),
+        _mm256_mul_ps(_mm256_set1_ps(0.5f), z)),
+      _mm256_set1_ps(1.0f));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_sin2_avx2(__m256 x) {
+  __m256i n;
+  __m256 r = hvf_reduce_avx2(x, &n);
+  __m256 z = _mm256_mul_ps(r, r);
+  __m256 odd = _mm256_castsi256_ps(_mm256_slli_epi32(n, 31));
+  __m256 s = _mm256_blendv_ps(
+      hvf_sin_poly_avx2(r, z), hvf_cos_poly_avx2(z), odd);
+  return _mm256_mul_ps(s, s);
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_cos_avx2(__m256 x) {
+  __m256i n;
+  __m256 r = hvf_reduce_avx2(x, &n);
+  __m256 z = _mm256_mul_ps(r, r);
+  __m256 odd = _mm256_castsi256_ps(_mm256_slli_epi32(n, 31));
+  __m256 c = _mm256_blendv_ps(
+      hvf_cos_poly_avx2(z), hvf_sin_poly_avx2(r, z), odd);
+  __m256i sign = _mm256_slli_epi32(
+      _mm256_srli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(1)), 1), 31);
+  return _mm256_xor_ps(c, _mm256_castsi256_ps(sign));
+}
+
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_asin_sqrt_avx2(__m256 a) {
+  __m256 one = _mm256_set1_ps(1.0f);
+  a = _mm256_blendv_ps(a, one, _mm256_cmp_ps(a, one, _CMP_GT_OQ));
+  __m256 s = _mm256_sqrt_ps(a);
+  __m256 big = _mm256_cmp_ps(a, _mm256_set1_ps(0.25f), _CMP_GT_OQ);
+  __m256 z = _mm256_blendv_ps(a, _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_set1_ps(1.0f), s), _mm256_set1_ps(0.5f)), big);
+  __m256 x = _mm256_blendv_ps(s, _mm256_sqrt_ps(z), big);
+  __m256 p = hvf_horner_avx2(z, HVF_AS3, _mm256_set1_ps(HVF_AS4));
+  p = hvf_horner_avx2(z, HVF_AS2, p);
+  p = hvf_horner_avx2(z, HVF_AS1, p);
+  p = hvf_horner_avx2(z, HVF_AS0, p);
+  p = _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(p, z), x));
+  return _mm256_blendv_ps(p,
+      _mm256_sub_ps(_mm256_set1_ps(HVF_PIO2), _mm256_add_ps(p, p)), big);
+}
+
+// Rounds 8 f64 to f32
+__attribute__((target("avx2")))
+static FORCE_INLINE __m256 hvf_narrow_avx2(__m256d lo, __m256d hi) {
+  return _mm256_set_m128(_mm256_cvtpd_ps(hi), _mm256_cvtpd_ps(lo));
+}
+
+// Returns false if any argument is out of range, `out_dist` is undefined then
+__attribute__((target("avx2")))
+static FORCE_INLINE b32 hvf_dist_avx2(__m256 x0, __m256 y0, __m256 x1,
+    __m256 y1, f64 earth_rad, __m256 *out_dist) {
+  __m256 deg2rad = _mm256_set1_ps(HVF_DEG2RAD);
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 dlat = _mm256_mul_ps(
+      _mm256_mul_ps(_mm256_sub_ps(y1, y0), deg2rad), half);
+  __m256 dlon = _mm256_mul_ps(
+      _mm256_mul_ps(_mm256_sub_ps(x1, x0), deg2rad), half);
+  __m256 lat0 = _mm256_mul_ps(y0, deg2rad);
+  __m256 lat1 = _mm256_mul_ps(y1, deg2rad);
+
+  __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 max = _mm256_set1_ps(HVF_REDUCE_MAX);
+  __m256 in_range = _mm256_and_ps(
+      _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_and_ps(dlat, abs_mask), max, _CMP_LE_OQ),
+        _mm256_cmp_ps(_mm256_and_ps(dlon, abs_mask), max, _CMP_LE_OQ)),
+      _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_and_ps(lat0, abs_mask), max, _CMP_LE_OQ),
+        _mm256_cmp_ps(_mm256_and_ps(lat1, abs_mask), max, _CMP_LE_OQ)));
+  if (UNLIKELY(_mm256_movemask_ps(in_range) != 0xFF)) {
+    return false;
+  }
+
+  __m256 a = _mm256_add_ps(hvf_sin2_avx2(dlat),
+      _mm256_mul_ps(
+        _mm256_mul_ps(hvf_cos_avx2(lat0), hvf_cos_avx2(lat1)),
+        hvf_sin2_avx2(dlon)));
+  __m256 c = _mm256_mul_ps(_mm256_set1_ps(2.0f), hvf_asin_sqrt_avx2(a));
+  *out_dist = _mm256_mul_ps(_mm256_set1_ps((f32)earth_rad), c);
+  return true;
+}
+
+// `x0` ... `y1` point to the first pair of the block, `stride` is 1 or 4
+__attribute__((target("avx2")))
+static FORCE_INLINE void hvf_block_avx2(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 stride, f64 earth_rad,
+    __m256d acc[2], f64 *out_dists) {
+  __m256 vx0, vy0, vx1, vy1;
+  if (stride == 4) {
+    __m256d x0d[2], y0d[2], x1d[2], y1d[2];
+    hv_load_aos_avx2(x0,      x0d + 0, y0d + 0, x1d + 0, y1d + 0);
+    hv_load_aos_avx2(x0 + 16, x0d + 1, y0d + 1, x1d + 1, y1d + 1);
+    vx0 = hvf_narrow_avx2(x0d[0], x0d[1]);
+    vy0 = hvf_narrow_avx2(y0d[0], y0d[1]);
+    vx1 = hvf_narrow_avx2(x1d[0], x1d[1]);
+    vy1 = hvf_narrow_avx2(y1d[0], y1d[1]);
+  } else {
+    vx0 = hvf_narrow_avx2(_mm256_loadu_pd(x0), _mm256_loadu_pd(x0 + 4));
+    vy0 = hvf_narrow_avx2(_mm256_loadu_pd(y0), _mm256_loadu_pd(y0 + 4));
+    vx1 = hvf_narrow_avx2(_mm256_loadu_pd(x1), _mm256_loadu_pd(x1 + 4));
+    vy1 = hvf_narrow_avx2(_mm256_loadu_pd(y1), _mm256_loadu_pd(y1 + 4));
+  }
+
+  __m256 dist;
+  __m256d dist_lo;
+  __m256d dist_hi;
+  if (LIKELY(hvf_dist_avx2(vx0, vy0, vx1, vy1, earth_rad, &dist))) {
+    dist_lo = _mm256_cvtps_pd(_mm256_castps256_ps128(dist));
+    dist_hi = _mm256_cvtps_pd(_mm256_extractf128_ps(dist, 1));
+  } else {
+    f64 dists[HV_LANES];
+    hvf_dists_libm(x0, y0, x1, y1, stride, earth_rad, dists);
+    dist_lo = _mm256_loadu_pd(dists);
+    dist_hi = _mm256_loadu_pd(dists + 4);
+  }
+  acc[0] = _mm256_add_pd(acc[0], dist_lo);
+  acc[1] = _mm256_add_pd(acc[1], dist_hi);
+  if (out_dists) {
+    _mm256_storeu_pd(out_dists, dist_lo);
+    _mm256_storeu_pd(out_dists + 4, dist_hi);
+  }
+}
+
+__attribute__((target("avx2")))
+static f64 harvestine_sum_aos_f32_avx2(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  __m256d acc[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    const f64 *c = coords + i * 4;
+    hvf_block_avx2(c, c + 1, c + 2, c + 3, 4, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    f64 tail_dists[HV_LANES];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hvf_block_avx2(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx2(acc);
+}
+
+__attribute__((target("avx2")))
+static f64 harvestine_sum_soa_f32_avx2(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  __m256d acc[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hvf_block_avx2(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    f64 tail_dists[HV_LANES];
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    hvf_block_avx2(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx2(acc);
+}
+
+// AVX-512: 2 x HV_LANES lanes per block, out of range arguments fall back to
+// libm per half, so results match 8 lane kernels
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_reduce_avx512(__m512 x, __m512i *out_n) {
+  __m512 magic = _mm512_set1_ps(HVF_ROUND_MAGIC);
+  __m512 t = _mm512_add_ps(
+      _mm512_mul_ps(x, _mm512_set1_ps(HVF_TWO_OVER_PI)), magic);
+  __m512 n = _mm512_sub_ps(t, magic);
+  __m512 r = _mm512_sub_ps(x, _mm512_mul_ps(n, _mm512_set1_ps(HVF_PIO2_1)));
+  r = _mm512_sub_ps(r, _mm512_mul_ps(n, _mm512_set1_ps(HVF_PIO2_2)));
+  r = _mm512_sub_ps(r, _mm512_mul_ps(n, _mm512_set1_ps(HVF_PIO2_3)));
+  *out_n = _mm512_castps_si512(t);
+  return r;
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_horner_avx512(__m512 z, f32 c0, __m512 p) {
+  return _mm512_add_ps(_mm512_set1_ps(c0), _mm512_mul_ps(z, p));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_sin_poly_avx512(__m512 r, __m512 z) {
+  __m512 s = hvf_horner_avx512(z, HVF_S2, _mm512_set1_ps(HVF_S3));
+  s = hvf_horner_avx512(z, HVF_S1, s);
+  return _mm512_add_ps(r, _mm512_mul_ps(_mm512_mul_ps(z, r), s));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_cos_poly_avx512(__m512 z) {
+  __m512 c = hvf_horner_avx512(z, HVF_C2, _mm512_set1_ps(HVF_C3));
+  c = hvf_horner_avx512(z, HVF_C1, c);
+  return _mm512_add_ps(
+      _mm512_sub_ps(_mm512_mul_ps(_mm512_mul_ps(z, z), c),
+        _mm512_mul_ps(_mm512_set1_ps(0.5f), z)),
+      _mm512_set1_ps(1.0f));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_sin2_avx512(__m512 x) {
+  __m512i n;
+  __m512 r = hvf_reduce_avx512(x, &n);
+  __m512 z = _mm512_mul_ps(r, r);
+  __mmask16 odd = _mm512_test_epi32_mask(n, _mm512_set1_epi32(1));
+  __m512 s = _mm512_mask_blend_ps(odd,
+      hvf_sin_poly_avx512(r, z), hvf_cos_poly_avx512(z));
+  return _mm512_mul_ps(s, s);
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_cos_avx512(__m512 x) {
+  __m512i n;
+  __m512 r = hvf_reduce_avx512(x, &n);
+  __m512 z = _mm512_mul_ps(r, r);
+  __mmask16 odd = _mm512_test_epi32_mask(n, _mm512_set1_epi32(1));
+  __m512 c = _mm512_mask_blend_ps(odd,
+      hvf_cos_poly_avx512(z), hvf_sin_poly_avx512(r, z));
+  __m512i sign = _mm512_slli_epi32(
+      _mm512_srli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(1)), 1), 31);
+  return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(c), sign));
+}
+
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_asin_sqrt_avx512(__m512 a) {
+  __m512 one = _mm512_set1_ps(1.0f);
+  a = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, one, _CMP_GT_OQ), a, one);
+  __m512 s = _mm512_sqrt_ps(a);
+  __mmask16 big = _mm512_cmp_ps_mask(a, _mm512_set1_ps(0.25f), _CMP_GT_OQ);
+  __m512 z = _mm512_mask_blend_ps(big, a, _mm512_mul_ps(
+        _mm512_sub_ps(_mm512_set1_ps(1.0f), s), _mm512_set1_ps(0.5f)));
+  __m512 x = _mm512_mask_blend_ps(big, s, _mm512_sqrt_ps(z));
+  __m512 p = hvf_horner_avx512(z, HVF_AS3, _mm512_set1_ps(HVF_AS4));
+  p = hvf_horner_avx512(z, HVF_AS2, p);
+  p = hvf_horner_avx512(z, HVF_AS1, p);
+  p = hvf_horner_avx512(z, HVF_AS0, p);
+  p = _mm512_add_ps(x, _mm512_mul_ps(_mm512_mul_ps(p, z), x));
+  return _mm512_mask_blend_ps(big, p,
+      _mm512_sub_ps(_mm512_set1_ps(HVF_PIO2), _mm512_add_ps(p, p)));
+}
+
+// Rounds 16 f64 to f32
+__attribute__((target("avx512f")))
+static FORCE_INLINE __m512 hvf_narrow_avx512(__m512d lo, __m512d hi) {
+  __m256 lo_ps = _mm512_cvtpd_ps(lo);
+  __m256 hi_ps = _mm512_cvtpd_ps(hi);
+  return _mm512_castpd_ps(_mm512_insertf64x4(
+        _mm512_castpd256_pd512(_mm256_castps_pd(lo_ps)),
+        _mm256_castps_pd(hi_ps), 1));
+}
+
+// Returns mask of lanes with arguments in range
+__attribute__((target("avx512f")))
+static FORCE_INLINE __mmask16 hvf_dist_avx512(__m512 x0, __m512 y0,
+    __m512 x1, __m512 y1, f64 earth_rad, __m512 *out_dist) {
+  __m512 deg2rad = _mm512_set1_ps(HVF_DEG2RAD);
+  __m512 half = _mm512_set1_ps(0.5f);
+  __m512 dlat = _mm512_mul_ps(
+      _mm512_mul_ps(_mm512_sub_ps(y1, y0), deg2rad), half);
+  __m512 dlon = _mm512_mul_ps(
+      _mm512_mul_ps(_mm512_sub_ps(x1, x0), deg2rad), half);
+  __m512 lat0 = _mm512_mul_ps(y0, deg2rad);
+  __m512 lat1 = _mm512_mul_ps(y1, deg2rad);
+
+  __m512 max = _mm512_set1_ps(HVF_REDUCE_MAX);
+  __mmask16 in_range =
+    _mm512_cmp_ps_mask(_mm512_abs_ps(dlat), max, _CMP_LE_OQ)
+    & _mm512_cmp_ps_mask(_mm512_abs_ps(dlon), max, _CMP_LE_OQ)
+    & _mm512_cmp_ps_mask(_mm512_abs_ps(lat0), max, _CMP_LE_OQ)
+    & _mm512_cmp_ps_mask(_mm512_abs_ps(lat1), max, _CMP_LE_OQ);
+
+  __m512 a = _mm512_add_ps(hvf_sin2_avx512(dlat),
+      _mm512_mul_ps(
+        _mm512_mul_ps(hvf_cos_avx512(lat0), hvf_cos_avx512(lat1)),
+        hvf_sin2_avx512(dlon)));
+  __m512 c = _mm512_mul_ps(_mm512_set1_ps(2.0f), hvf_asin_sqrt_avx512(a));
+  *out_dist = _mm512_mul_ps(_mm512_set1_ps((f32)earth_rad), c);
+  return in_range;
+}
+
+// `x0` ... `y1` point to the first pair of the block, `stride` is 1 or 4
+__attribute__((target("avx512f")))
+static FORCE_INLINE void hvf_block_avx512(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 stride, f64 earth_rad, __m512d *acc,
+    f64 *out_dists) {
+  __m512 vx0, vy0, vx1, vy1;
+  if (stride == 4) {
+    __m512d x0d[2], y0d[2], x1d[2], y1d[2];
+    hv_load_aos_avx512(x0,      x0d + 0, y0d + 0, x1d + 0, y1d + 0);
+    hv_load_aos_avx512(x0 + 32, x0d + 1, y0d + 1, x1d + 1, y1d + 1);
+    vx0 = hvf_narrow_avx512(x0d[0], x0d[1]);
+    vy0 = hvf_narrow_avx512(y0d[0], y0d[1]);
+    vx1 = hvf_narrow_avx512(x1d[0], x1d[1]);
+    vy1 = hvf_narrow_avx512(y1d[0], y1d[1]);
+  } else {
+    vx0 = hvf_narrow_avx512(_mm512_loadu_pd(x0), _mm512_loadu_pd(x0 + 8));
+    vy0 = hvf_narrow_avx512(_mm512_loadu_pd(y0), _mm512_loadu_pd(y0 + 8));
+    vx1 = hvf_narrow_avx512(_mm512_loadu_pd(x1), _mm512_loadu_pd(x1 + 8));
+    vy1 = hvf_narrow_avx512(_mm512_loadu_pd(y1), _mm512_loadu_pd(y1 + 8));
+  }
+
+  __m512 dist;
+  __mmask16 in_range = hvf_dist_avx512(vx0, vy0, vx1, vy1, earth_rad, &dist);
+  __m512d dists[2] = {
+    _mm512_cvtps_pd(_mm512_castps512_ps256(dist)),
+    _mm512_cvtps_pd(_mm256_castpd_ps(
+          _mm512_extractf64x4_pd(_mm512_castps_pd(dist), 1))),
+  };
+  for (u64 h = 0; h < 2; ++h) {
+    if (UNLIKELY(((in_range >> (h * HV_LANES)) & 0xFF) != 0xFF)) {
+      u64 offset = h * HV_LANES * stride;
+      f64 libm_dists[HV_LANES];
+      hvf_dists_libm(x0 + offset, y0 + offset, x1 + offset, y1 + offset,
+          stride, earth_rad, libm_dists);
+      dists[h] = _mm512_loadu_pd(libm_dists);
+    }
+    *acc = _mm512_add_pd(*acc, dists[h]);
+    if (out_dists) {
+      _mm512_storeu_pd(out_dists + h * HV_LANES, dists[h]);
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static f64 harvestine_sum_aos_f32_avx512(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  enum {L = 2 * HV_LANES};
+  __m512d acc = _mm512_setzero_pd();
+  u64 i = 0;
+  for (; i + L <= pair_count; i += L) {
+    const f64 *c = coords + i * 4;
+    hvf_block_avx512(c, c + 1, c + 2, c + 3, 4, earth_rad, &acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[L * 4] = {0};
+    f64 tail_dists[L];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hvf_block_avx512(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, &acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx512(acc);
+}
+
+__attribute__((target("avx512f")))
+static f64 harvestine_sum_soa_f32_avx512(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  enum {L = 2 * HV_LANES};
+  __m512d acc = _mm512_setzero_pd();
+  u64 i = 0;
+  for (; i + L <= pair_count; i += L) {
+    hvf_block_avx512(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, &acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][L] = {0};
+    f64 tail_dists[L];
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    hvf_block_avx512(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, &acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_avx512(acc);
+}
+
+#elif defined(__aarch64__)
+
+// NEON: 2 x 4 lanes per block
+
+static FORCE_INLINE float32x4_t hvf_reduce_neon(float32x4_t x,
+    uint32x4_t *out_n) {
+  float32x4_t magic = vdupq_n_f32(HVF_ROUND_MAGIC);
+  float32x4_t t = vaddq_f32(vmulq_f32(x, vdupq_n_f32(HVF_TWO_OVER_PI)), magic);
+  float32x4_t n = vsubq_f32(t, magic);
+  float32x4_t r = vsubq_f32(x, vmulq_f32(n, vdupq_n_f32(HVF_PIO2_1)));
+  r = vsubq_f32(r, vmulq_f32(n, vdupq_n_f32(HVF_PIO2_2)));
+  r = vsubq_f32(r, vmulq_f32(n, vdupq_n_f32(HVF_PIO2_3)));
+  *out_n = vreinterpretq_u32_f32(t);
+  return r;
+}
+
+static FORCE_INLINE float32x4_t hvf_horner_neon(float32x4_t z, f32 c0,
+    float32x4_t p) {
+  return vaddq_f32(vdupq_n_f32(c0), vmulq_f32(z, p));
+}
+
+static FORCE_INLINE float32x4_t hvf_sin_poly_neon(float32x4_t r,
+    float32x4_t z) {
+  float32x4_t s = hvf_horner_neon(z, HVF_S2, vdupq_n_f32(HVF_S3));
+  s = hvf_horner_neon(z, HVF_S1, s);
+  return vaddq_f32(r, vmulq_f32(vmulq_f32(z, r), s));
+}
+
+static FORCE_INLINE float32x4_t hvf_cos_poly_neon(float32x4_t z) {
+  float32x4_t c = hvf_horner_neon(z, HVF_C2, vdupq_n_f32(HVF_C3));
+  c = hvf_horner_neon(z, HVF_C1, c);
+  return vaddq_f32(
+      vsubq_f32(vmulq_f32(vmulq_f32(z, z), c),
+        vmulq_f32(vdupq_n_f32(0.5f), z)),
+      vdupq_n_f32(1.0f));
+}
+
+static FORCE_INLINE float32x4_t hvf_sin2_neon(float32x4_t x) {
+  uint32x4_t n;
+  float32x4_t r = hvf_reduce_neon(x, &n);
+  float32x4_t z = vmulq_f32(r, r);
+  uint32x4_t odd = vtstq_u32(n, vdupq_n_u32(1));
+  float32x4_t s = vbslq_f32(odd, hvf_cos_poly_neon(z),
+      hvf_sin_poly_neon(r, z));
+  return vmulq_f32(s, s);
+}
+
+static FORCE_INLINE float32x4_t hvf_cos_neon(float32x4_t x) {
+  uint32x4_t n;
+  float32x4_t r = hvf_reduce_neon(x, &n);
+  float32x4_t z = vmulq_f32(r, r);
+  uint32x4_t odd = vtstq_u32(n, vdupq_n_u32(1));
+  float32x4_t c = vbslq_f32(odd, hvf_sin_poly_neon(r, z),
+      hvf_cos_poly_neon(z));
+  uint32x4_t sign = vshlq_n_u32(
+      vshrq_n_u32(vaddq_u32(n, vdupq_n_u32(1)), 1), 31);
+  return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(c), sign));
+}
+
+static FORCE_INLINE float32x4_t hvf_asin_sqrt_neon(float32x4_t a) {
+  float32x4_t one = vdupq_n_f32(1.0f);
+  a = vbslq_f32(vcgtq_f32(a, one), one, a);
+  float32x4_t s = vsqrtq_f32(a);
+  uint32x4_t big = vcgtq_f32(a, vdupq_n_f32(0.25f));
+  float32x4_t z = vbslq_f32(big,
+      vmulq_f32(vsubq_f32(vdupq_n_f32(1.0f), s), vdupq_n_f32(0.5f)), a);
+  float32x4_t x = vbslq_f32(big, vsqrtq_f32(z), s);
+  float32x4_t p = hvf_horner_neon(z, HVF_AS3, vdupq_n_f32(HVF_AS4));
+  p = hvf_horner_neon(z, HVF_AS2, p);
+  p = hvf_horner_neon(z, HVF_AS1, p);
+  p = hvf_horner_neon(z, HVF_AS0, p);
+  p = vaddq_f32(x, vmulq_f32(vmulq_f32(p, z), x));
+  return vbslq_f32(big, vsubq_f32(vdupq_n_f32(HVF_PIO2), vaddq_f32(p, p)), p);
+}
+
+static FORCE_INLINE b32 hvf_dist_neon(float32x4_t x0, float32x4_t y0,
+    float32x4_t x1, float32x4_t y1, f64 earth_rad, float32x4_t *out_dist) {
+  float32x4_t deg2rad = vdupq_n_f32(HVF_DEG2RAD);
+  float32x4_t half = vdupq_n_f32(0.5f);
+  float32x4_t dlat = vmulq_f32(vmulq_f32(vsubq_f32(y1, y0), deg2rad), half);
+  float32x4_t dlon = vmulq_f32(vmulq_f32(vsubq_f32(x1, x0), deg2rad), half);
+  float32x4_t lat0 = vmulq_f32(y0, deg2rad);
+  float32x4_t lat1 = vmulq_f32(y1, deg2rad);
+
+  float32x4_t max = vdupq_n_f32(HVF_REDUCE_MAX);
+  uint32x4_t in_range = vandq_u32(
+      vandq_u32(vcaleq_f32(dlat, max), vcaleq_f32(dlon, max)),
+      vandq_u32(vcaleq_f32(lat0, max), vcaleq_f32(lat1, max)));
+  if (UNLIKELY(vminvq_u32(in_range) == 0)) {
+    return false;
+  }
+
+  float32x4_t a = vaddq_f32(hvf_sin2_neon(dlat),
+      vmulq_f32(vmulq_f32(hvf_cos_neon(lat0), hvf_cos_neon(lat1)),
+        hvf_sin2_neon(dlon)));
+  float32x4_t c = vmulq_f32(vdupq_n_f32(2.0f), hvf_asin_sqrt_neon(a));
+  *out_dist = vmulq_f32(vdupq_n_f32((f32)earth_rad), c);
+  return true;
+}
+
+// Rounds 4 f64 to f32
+static FORCE_INLINE float32x4_t hvf_narrow_neon(float64x2_t lo,
+    float64x2_t hi) {
+  return vcvt_high_f32_f64(vcvt_f32_f64(lo), hi);
+}
+
+// Loads 4 pairs starting at `x0` ... `y1` rounded to f32
+static FORCE_INLINE void hvf_load_neon(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 stride, float32x4_t *out_x0,
+    float32x4_t *out_y0, float32x4_t *out_x1, float32x4_t *out_y1) {
+  if (stride == 4) {
+    float64x2x4_t lo = vld4q_f64(x0);
+    float64x2x4_t hi = vld4q_f64(x0 + 8);
+    *out_x0 = hvf_narrow_neon(lo.val[0], hi.val[0]);
+    *out_y0 = hvf_narrow_neon(lo.val[1], hi.val[1]);
+    *out_x1 = hvf_narrow_neon(lo.val[2], hi.val[2]);
+    *out_y1 = hvf_narrow_neon(lo.val[3], hi.val[3]);
+  } else {
+    *out_x0 = hvf_narrow_neon(vld1q_f64(x0), vld1q_f64(x0 + 2));
+    *out_y0 = hvf_narrow_neon(vld1q_f64(y0), vld1q_f64(y0 + 2));
+    *out_x1 = hvf_narrow_neon(vld1q_f64(x1), vld1q_f64(x1 + 2));
+    *out_y1 = hvf_narrow_neon(vld1q_f64(y1), vld1q_f64(y1 + 2));
+  }
+}
+
+static FORCE_INLINE void hvf_block_neon(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 stride, f64 earth_rad,
+    float64x2_t acc[4], f64 *out_dists) {
+  float64x2_t dist[4];
+  b32 in_range = true;
+  for (u64 k = 0; k < 2; ++k) {
+    u64 i = k * 4 * stride;
+    float32x4_t vx0, vy0, vx1, vy1, d;
+    hvf_load_neon(x0 + i, y0 + i, x1 + i, y1 + i, stride,
+        &vx0, &vy0, &vx1, &vy1);
+    in_range &= hvf_dist_neon(vx0, vy0, vx1, vy1, earth_rad, &d);
+    dist[k * 2 + 0] = vcvt_f64_f32(vget_low_f32(d));
+    dist[k * 2 + 1] = vcvt_high_f64_f32(d);
+  }
+
+  if (UNLIKELY(!in_range)) {
+    f64 dists[HV_LANES];
+    hvf_dists_libm(x0, y0, x1, y1, stride, earth_rad, dists);
+    for (u64 k = 0; k < 4; ++k) {
+      dist[k] = vld1q_f64(dists + k * 2);
+    }
+  }
+  for (u64 k = 0; k < 4; ++k) {
+    acc[k] = vaddq_f64(acc[k], dist[k]);
+    if (out_dists) {
+      vst1q_f64(out_dists + k * 2, dist[k]);
+    }
+  }
+}
+
+static f64 harvestine_sum_aos_f32_neon(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists) {
+  float64x2_t acc[4] = {0};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    const f64 *c = coords + i * 4;
+    hvf_block_neon(c, c + 1, c + 2, c + 3, 4, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[HV_LANES * 4] = {0};
+    f64 tail_dists[HV_LANES];
+    memcpy(tail, coords + i * 4, (pair_count - i) * 4 * sizeof(f64));
+    hvf_block_neon(tail, tail + 1, tail + 2, tail + 3, 4, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_neon(acc);
+}
+
+static f64 harvestine_sum_soa_f32_neon(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists) {
+  float64x2_t acc[4] = {0};
+  u64 i = 0;
+  for (; i + HV_LANES <= pair_count; i += HV_LANES) {
+    hvf_block_neon(x0 + i, y0 + i, x1 + i, y1 + i, 1, earth_rad, acc,
+        out_dists ? out_dists + i : 0);
+  }
+  if (i < pair_count) {
+    f64 tail[4][HV_LANES] = {0};
+    f64 tail_dists[HV_LANES];
+    u64 size = (pair_count - i) * sizeof(f64);
+    memcpy(tail[0], x0 + i, size);
+    memcpy(tail[1], y0 + i, size);
+    memcpy(tail[2], x1 + i, size);
+    memcpy(tail[3], y1 + i, size);
+    hvf_block_neon(tail[0], tail[1], tail[2], tail[3], 1, earth_rad, acc,
+        tail_dists);
+    hv_copy_tail_dists(out_dists, i, pair_count, tail_dists);
+  }
+  return hv_acc_sum_neon(acc);
+}
+
+#endif // #if defined(__x86_64__) #elif defined(__aarch64__)
+
+// --------------------------------------
+// Dispatch
+// --------------------------------------
+
+// Ordered from the narrowest to the widest
+static const struct harvestine_kernel s_harvestine_kernels[] = {
+  {"scalar",  hv_supported_always,
+    harvestine_sum_aos_scalar, harvestine_sum_soa_scalar,
+    harvestine_sum_aos_f32_scalar, harvestine_sum_soa_f32_scalar},
+#if defined(__x86_64__)
+  {"avx2",    hv_supported_avx2,
+    harvestine_sum_aos_avx2, harvestine_sum_soa_avx2,
+    harvestine_sum_aos_f32_avx2, harvestine_sum_soa_f32_avx2},
+  {"avx512",  hv_supported_avx512,
+    harvestine_sum_aos_avx512, harvestine_sum_soa_avx512,
+    harvestine_sum_aos_f32_avx512, harvestine_sum_soa_f32_avx512},
+#elif defined(__aarch64__)
+  {"neon",    hv_supported_neon,
+    harvestine_sum_aos_neon, harvestine_sum_soa_neon,
+    harvestine_sum_aos_f32_neon, harvestine_sum_soa_f32_neon},
+#endif
+};
+
+const struct harvestine_kernel *harvestine_kernel_find(const char *name) {
+  if (strcmp(name, "auto") == 0) {
+    for (u64 i = ARRAY_COUNT(s_harvestine_kernels); i-- > 0;) {
+      if (s_harvestine_kernels[i].is_supported()) {
+        return s_harvestine_kernels + i;
+      }
+    }
+    return 0;
+  }
+
+  for (u64 i = 0; i < ARRAY_COUNT(s_harvestine_kernels); ++i) {
+    const struct harvestine_kernel *k = s_harvestine_kernels + i;
+    if (strcmp(name, k->name) == 0) {
+      return k->is_supported() ? k : 0;
+    }
+  }
+  return 0;
+}
+
+const char *harvestine_kernel_names(void) {
+#if defined(__x86_64__)
+  return "scalar avx2 avx512";
+#elif defined(__aarch64__)
+  return "scalar neon";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "types.h"
+
+// Vectorized harvestine distance sums
+//
+// Same math as calc_harvestine(), but sin, cos and asin are replaced with
+// range reduced polynomial approximations, so there are no libm calls:
+// * sin, cos: Cody-Waite reduction to [-pi/4, pi/4] with 3 part pi/2,
+//   fdlibm k_sin.c and k_cos.c polynomials
+// * asin(sqrt(a)): fdlibm e_asin.c rational approximation,
+//   asin(x) = pi/2 - 2 * asin(sqrt((1 - x) / 2)) for x >= 0.5
+//
+// Accuracy against calc_harvestine() (libm reference), measured over 8M
+// random, close and near antipodal pairs:
+// * a <= 0.99 (central angle up to ~169 deg): max 8 ULP, mean 0.23 ULP.
+//   Both are within 6 ULP of the same formula evaluated in long double.
+// * a -> 1 (antipodal): asin(sqrt(a)) is ill-conditioned, 1 ULP of `a` turns
+//   into up to 10^6 ULP of distance, for libm as well. Absolute error of
+//   both against long double is up to 2e-4 km.
+//
+// Kernels evaluate the same sequence of IEEE operations (no FMA) and sum
+// distances in HARVESTINE_SIMD_LANE_COUNT lanes that are added up in a fixed
+// order, so every kernel returns bit identical sums for the same input.
+// Blocks of pairs with sin or cos arguments outside of
+// [-HARVESTINE_SIMD_REDUCE_MAX, HARVESTINE_SIMD_REDUCE_MAX] radians, infinity
+// or NaN fall back to calc_harvestine().
+//
+// f32 kernels round coordinates to f32 on load and calculate in f32 with
+// Cephes sinf.c and asinf.c polynomials, twice as many lanes per instruction.
+// Distances are returned and summed in f64. For a <= 0.99 they are within
+// 8 ULP (mean 0.32 ULP) of calc_harvestine_f32(), max absolute error against
+// calc_harvestine() is 0.015 km, near antipodes up to 6.1 km.
+// `a` above 1 is clamped, so f32 rounding never produces NaN.
+// Use harvestine --validate to check error on your data.
+//
+// Usage:
+//  const struct harvestine_kernel *k = harvestine_kernel_find("auto");
+//  f64 sum = k->sum_soa(x0, y0, x1, y1, pair_count, EARTH_RAD, 0);
+
+enum {HARVESTINE_SIMD_LANE_COUNT = 8};
+
+#define HARVESTINE_SIMD_REDUCE_MAX 1e5
+
+// Sum of harvestine distances of x0 y0 x1 y1 records (AoS).
+// If `out_dists` is not 0, distance of every pair is stored there.
+typedef f64 harvestine_sum_aos_func_t(const f64 *coords, u64 pair_count,
+    f64 earth_rad, f64 *out_dists);
+
+// Sum of harvestine distances of x0[], y0[], x1[], y1[] columns (SoA).
+// If `out_dists` is not 0, distance of every pair is stored there.
+typedef f64 harvestine_sum_soa_func_t(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count, f64 earth_rad,
+    f64 *out_dists);
+
+struct harvestine_kernel {
+  const char *name;
+  b32 (*is_supported)(void);  // does this CPU support the kernel
+  harvestine_sum_aos_func_t *sum_aos;
+  harvestine_sum_soa_func_t *sum_soa;
+  harvestine_sum_aos_func_t *sum_aos_f32; // f32 precision
+  harvestine_sum_soa_func_t *sum_soa_f32; // f32 precision
+};
+
+// Returns kernel by name, "auto" picks the widest kernel supported by CPU.
+// Returns 0 if there is no such kernel or CPU doesn't support it.
+const struct harvestine_kernel *harvestine_kernel_find(const char *name);
+
+// Space separated names of all kernels built for this architecture
+const char *harvestine_kernel_names(void);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "types.h"
+
+// Binary coordinates file
+//
+// Coordinate pairs stored as raw f64, so they can be memory mapped and fed
+// straight into distance calculation without parsing or copying.
+//
+// File layout:
+//  [struct coords_bin_header][zero padding]
+//  data at `data_offset`:
+//  * AoS: `pair_count` records of x0 y0 x1 y1
+//  * SoA: x0[pair_count] [padding] y0[] [padding] x1[] [padding] y1[]
+//    columns start `column_stride` bytes apart
+//
+// Data and every SoA column start at COORDS_BIN_ALIGN byte boundary.
+// Checksum is coords_bin_hash() of all f64 values in file order, padding is
+// not included.
+// NOTE: little endian only.
+
+// "HVCOORDS"
+#define COORDS_BIN_MAGIC    0x5344524F4F435648LLU
+#define COORDS_BIN_VERSION  1
+#define COORDS_BIN_ALIGN    64
+
+// FNV-1a offset basis
+#define COORDS_BIN_HASH_SEED 0xCBF29CE484222325LLU
+
+enum coords_bin_layout {
+  COORDS_BIN_LAYOUT_AOS,
+  COORDS_BIN_LAYOUT_SOA,
+
+  COORDS_BIN_LAYOUT_COUNT,
+};
+
+struct coords_bin_header {
+  u64 magic;          // COORDS_BIN_MAGIC
+  u32 version;        // COORDS_BIN_VERSION
+  u32 layout;         // enum coords_bin_layout
+  u64 pair_count;
+  u64 data_offset;    // bytes from the beginning of file
+  u64 column_stride;  // SoA: bytes between columns, AoS: 0
+  u64 checksum;
+};
+
+static inline u64 coords_bin_align(u64 v) {
+  return (v + COORDS_BIN_ALIGN - 1) & ~(u64)(COORDS_BIN_ALIGN - 1);
+}
+
+static inline struct coords_bin_header coords_bin_header_make(
+    enum coords_bin_layout layout, u64 pair_count) {
+  return (struct coords_bin_header){
+    .magic          = COORDS_BIN_MAGIC,
+    .version        = COORDS_BIN_VERSION,
+    .layout         = layout,
+    .pair_count     = pair_count,
+    .data_offset    = coords_bin_align(sizeof(struct coords_bin_header)),
+    .column_stride  = layout == COORDS_BIN_LAYOUT_SOA
+      ? coords_bin_align(pair_count * sizeof(f64))
+      : 0,
+  };
+}
+
+// Expected file size described by the header
+static inline u64 coords_bin_file_size(const struct coords_bin_header *h) {
+  u64 data_size = h->layout == COORDS_BIN_LAYOUT_SOA
+    ? 3 * h->column_stride + h->pair_count * sizeof(f64)
+    : h->pair_count * 4 * sizeof(f64);
+  return h->data_offset + data_size;
+}
+
+// FNV-1a over 64-bit words. Every step is a bijection of the hash for a given
+// word, so any single corrupted value changes the result.
+// Chain calls by passing the previous result as `h`, start with
+// COORDS_BIN_HASH_SEED.
+static inline u64 coords_bin_hash(u64 h, const f64 *data, u64 count) {
+  for (u64 i = 0; i < count; ++i) {
+    u64 w;
+    __builtin_memcpy(&w, data + i, sizeof(w));
+    h = (h ^ w) * 0x100000001B3LLU;
+  }
+  return h;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "types.h"
+
+#include <stdio.h>      // snprintf
+#include <stdlib.h>     // strtod
+
+// f64 to shortest decimal formatter
+//
+// Prints the shortest fixed notation `[-]digits[.digits]` that parses back
+// (strtod(), parse_f64()) to the same bits, e.g. 0.1 is "0.1", not
+// "0.10000000000000001".
+// Among equally short decimals the closest to the exact value is picked.
+//
+// f64 is m * 2^e. Every decimal in the rounding interval around it
+// ((4m - 1 or 2) / 2^(2 - e), (4m + 2) / 2^(2 - e)) parses back to it.
+// With p digits after the decimal point there is such a decimal iff
+// ceil(lower * 10^p) <= floor(upper * 10^p). Scaled bounds are exact 128 bit
+// integers, division by 2^(2 - e) is a shift, so unlike Ryu or Grisu no
+// power tables are needed. p is found with a binary search over [0, 19].
+// * Exact path: 2^-64 <= |d| < 2^54 and at most 19 digits after the decimal
+//   point. Distances, coordinates and averages always fit.
+// * Everything else (zero excluded: subnormals, tiny and huge numbers,
+//   inf/nan) falls back to the shortest snprintf("%.*g") that survives
+//   strtod() round trip, it might use exponent notation.
+//
+// Usage:
+//  u8 buf[FORMAT_F64_SIZE_MAX];
+//  u8 *end = format_f64(buf, d);
+//  fwrite(buf, 1, end - buf, f);
+
+enum {
+  FORMAT_F64_SIZE_MAX   = 32, // "-1.2345678901234567e-308" fits
+  FORMAT_F64_FRAC_MAX   = 19, // 10^19 * (4m + 2) < 2^128
+};
+
+// `__extension__` silences -Wpedantic
+__extension__ typedef unsigned __int128 format_f64_u128;
+
+static const u64 s_format_f64_pow10[FORMAT_F64_FRAC_MAX + 1] = {
+  1LLU,
+  10LLU,
+  100LLU,
+  1000LLU,
+  10000LLU,
+  100000LLU,
+  1000000LLU,
+  10000000LLU,
+  100000000LLU,
+  1000000000LLU,
+  10000000000LLU,
+  100000000000LLU,
+  1000000000000LLU,
+  10000000000000LLU,
+  100000000000000LLU,
+  1000000000000000LLU,
+  10000000000000000LLU,
+  100000000000000000LLU,
+  1000000000000000000LLU,
+  10000000000000000000LLU,
+};
+
+// Decimal with `frac_count` digits after the decimal point in the interval
+// (`lower`, `upper`) / 2^`shift`, bounds are included if `inclusive`.
+// Returns false if there is none.
+static inline b32 format_f64_pick(u64 lower, u64 mid, u64 upper, u32 shift,
+    b32 inclusive, u32 frac_count, u64 *out_digits) {
+  format_f64_u128 k = s_format_f64_pow10[frac_count];
+  format_f64_u128 lo_n = lower * k;
+  format_f64_u128 hi_n = upper * k;
+  format_f64_u128 mask = ((format_f64_u128)1 << shift) - 1;
+
+  // ceil() and floor(), excluded bounds are moved inwards if exact
+  format_f64_u128 lo = (lo_n >> shift) + ((lo_n & mask) != 0 || !inclusive);
+  format_f64_u128 hi = (hi_n >> shift) - ((hi_n & mask) == 0 && !inclusive);
+  if (lo > hi) {
+    return false;
+  }
+
+  // Round to nearest, keep inside of the interval
+  format_f64_u128 half = (format_f64_u128)1 << (shift - 1);
+  format_f64_u128 c = (mid * k + half) >> shift;
+  c = c < lo ? lo : c;
+  c = c > hi ? hi : c;
+  *out_digits = (u64)c;
+  return true;
+}
+
+static inline u8 *format_f64_snprintf(u8 *p, f64 d) {
+  char buf[FORMAT_F64_SIZE_MAX];
+  int size = 0;
+  for (int precision = 1; precision <= 17; ++precision) {
+    size = snprintf(buf, sizeof(buf), "%.*g", precision, d);
+    if (strtod(buf, 0) == d) {
+      break;
+    }
+  }
+  __builtin_memcpy(p, buf, size);
+  return p + size;
+}
+
+// Write shortest round trip decimal of `d` at `p`, no '\0'.
+// Writes at most FORMAT_F64_SIZE_MAX bytes.
+// Returns pointer past the last written char.
+static inline u8 *format_f64(u8 *p, f64 d) {
+  u64 bits;
+  __builtin_memcpy(&bits, &d, sizeof(bits));
+
+  u64 m = bits & ((1LLU << 52) - 1);
+  i32 biased_exp = (i32)(bits >> 52) & 0x7FF;
+  i32 e = biased_exp - 1075;        // d = (m | implicit 1) * 2^e
+  i32 shift = 2 - e;
+
+  if (!m && !biased_exp) {
+    u8 *cur = p;
+    if (bits >> 63) {
+      *cur++ = '-';
+    }
+    *cur++ = '0';
+    return cur;
+  }
+  if (UNLIKELY(!biased_exp || shift < 1 || shift > 118)) {
+    return format_f64_snprintf(p, d);
+  }
+
+  // Interval around 4m, lower neighbour is twice as close for powers of 2
+  m |= 1LLU << 52;
+  u64 mid = 4 * m;
+  u64 lower = mid - (m == (1LLU << 52) && biased_exp > 1 ? 1 : 2);
+  u64 upper = mid + 2;
+  b32 inclusive = (m & 1) == 0;   // parser rounds ties to even
+
+  u64 digits;
+  if (UNLIKELY(!format_f64_pick(lower, mid, upper, shift, inclusive,
+          FORMAT_F64_FRAC_MAX, &digits))) {
+    return format_f64_snprintf(p, d);
+  }
+
+  // Having a decimal with n digits after the point implies one with n + 1
+  u32 frac_lo = 0;
+  u32 frac_hi = FORMAT_F64_FRAC_MAX;
+  while (frac_lo < frac_hi) {
+    u32 frac_mid = (frac_lo + frac_hi) / 2;
+    u64 candidate;
+    if (format_f64_pick(lower, mid, upper, shift, inclusive, frac_mid,
+          &candidate)) {
+      frac_hi = frac_mid;
+      digits = candidate;
+    } else {
+      frac_lo = frac_mid + 1;
+    }
+  }
+  u32 frac_count = frac_lo;
+
+  // Digits from the end: fraction, point, at least one integer digit
+  u8 buf[FORMAT_F64_SIZE_MAX];
+  u8 *end = buf + sizeof(buf);
+  u8 *cur = end;
+  for (u32 i = 0; i < frac_count; ++i) {
+    *--cur = '0' + digits % 10;
+    digits /= 10;
+  }
+  if (frac_count) {
+    *--cur = '.';
+  }
+  do {
+    *--cur = '0' + digits % 10;
+    digits /= 10;
+  } while (digits);
+  if (bits >> 63) {
+    *--cur = '-';
+  }
+
+  __builtin_memcpy(p, cur, end - cur);
+  return p + (end - cur);
+}
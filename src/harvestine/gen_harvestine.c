@@ -6,9 +6,10 @@
 
 #include "types.h"
 #include "calc_harvestine.h"
+#include "coords_bin.h"
 
-#include <stdio.h>      // printf fprintf fopen fwrite snprintf
-#include <stdlib.h>     // atol rand
+#include <stdio.h>      // printf fprintf fopen fwrite fseek snprintf
+#include <stdlib.h>     // atol rand malloc free
 #include <string.h>     // strcmp
 
 static void print_usage(void) {
@@ -17,9 +18,17 @@ static void print_usage(void) {
       "    <filename>.json    - JSON file with random coordinates.\n"
       "    <filename>.avg     - verification file with average of distances\n"
       "    <filename>.dists   - verification file with distances per pair\n"
+      "    <filename>.bin     - binary file with the same coordinates,\n"
+      "                         only with --bin option (see coords_bin.h)\n"
       "\n"
       "Usage:\n"
-      "    gen_harvestine <seed> <coord_pair_count> <filename>\n"
+      "    gen_harvestine [OPTIONS] <seed> <coord_pair_count> <filename>\n"
+      "\n"
+      "OPTIONS\n"
+      "    -h                - this help.\n"
+      "    --bin[=<layout>]  - also write binary file with layout:\n"
+      "                        aos - x0 y0 x1 y1 records (default)\n"
+      "                        soa - x0[] y0[] x1[] y1[] columns\n"
       );
 }
 
@@ -40,6 +49,76 @@ static FILE *file_open(const char *filename, const char *ext) {
     return f;
 }
 
+// Binary file writer. AoS records are written as they are generated,
+// SoA columns are collected in memory and written at the end.
+struct bin_writer {
+  FILE *f;
+  struct coords_bin_header header;
+  f64 *columns[4];
+  u64 size;
+};
+
+static b32 bin_writer_begin(struct bin_writer *w, FILE *f,
+    enum coords_bin_layout layout, u64 pair_count) {
+  *w = (struct bin_writer){
+    .f = f,
+    .header = coords_bin_header_make(layout, pair_count),
+  };
+  w->header.checksum = COORDS_BIN_HASH_SEED;
+
+  if (layout == COORDS_BIN_LAYOUT_SOA) {
+    for (u32 i = 0; i < 4; ++i) {
+      w->columns[i] = malloc(pair_count * sizeof(f64));
+      if (!w->columns[i]) {
+        perror("Error: malloc failed");
+        return false;
+      }
+    }
+  }
+
+  // Header is rewritten with the final checksum at the end
+  return fseek(f, w->header.data_offset, SEEK_SET) == 0;
+}
+
+static b32 bin_writer_push(struct bin_writer *w, const f64 coords[4]) {
+  if (w->header.layout == COORDS_BIN_LAYOUT_SOA) {
+    for (u32 i = 0; i < 4; ++i) {
+      w->columns[i][w->size] = coords[i];
+    }
+    ++w->size;
+    return true;
+  }
+
+  w->header.checksum = coords_bin_hash(w->header.checksum, coords, 4);
+  return fwrite(coords, sizeof(f64), 4, w->f) == 4;
+}
+
+static b32 bin_writer_end(struct bin_writer *w) {
+  b32 ret = true;
+  if (w->header.layout == COORDS_BIN_LAYOUT_SOA) {
+    const u8 zeros[COORDS_BIN_ALIGN] = {0};
+    u64 column_size = w->size * sizeof(f64);
+    for (u32 i = 0; i < 4 && ret; ++i) {
+      w->header.checksum =
+        coords_bin_hash(w->header.checksum, w->columns[i], w->size);
+      ret = fwrite(w->columns[i], sizeof(f64), w->size, w->f) == w->size;
+      if (ret && i < 3) {
+        u64 pad = w->header.column_stride - column_size;
+        ret = fwrite(zeros, 1, pad, w->f) == pad;
+      }
+    }
+  }
+
+  ret = ret
+    && fseek(w->f, 0, SEEK_SET) == 0
+    && fwrite(&w->header, sizeof(w->header), 1, w->f) == 1;
+
+  for (u32 i = 0; i < 4; ++i) {
+    free(w->columns[i]);
+  }
+  return ret;
+}
+
 int main(int argc, char **argv) {
   if (argc > 1 && strcmp(argv[1], "-h") == 0) {
     print_usage();
@@ -50,9 +129,29 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  i64 seed = atol(argv[1]);
-  i64 coord_pair_count = atol(argv[2]);
-  const char *filename = argv[3];
+  // options
+  b32 write_bin = false;
+  enum coords_bin_layout bin_layout = COORDS_BIN_LAYOUT_AOS;
+
+  int seed_argc = argc - 3;
+  for (int cur_argc = 1; cur_argc < seed_argc; ++cur_argc) {
+    const char *arg = argv[cur_argc];
+    if (strcmp(arg, "--bin") == 0 || strcmp(arg, "--bin=aos") == 0) {
+      write_bin = true;
+      bin_layout = COORDS_BIN_LAYOUT_AOS;
+    } else if (strcmp(arg, "--bin=soa") == 0) {
+      write_bin = true;
+      bin_layout = COORDS_BIN_LAYOUT_SOA;
+    } else {
+      fprintf(stderr, "Error: unrecognized option '%s'\n", arg);
+      print_usage();
+      return 1;
+    }
+  }
+
+  i64 seed = atol(argv[seed_argc]);
+  i64 coord_pair_count = atol(argv[seed_argc + 1]);
+  const char *filename = argv[seed_argc + 2];
 
   FILE *out_json  = file_open(filename, ".json");
   FILE *out_avg   = file_open(filename, ".avg");
@@ -61,6 +160,16 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  struct bin_writer bin = {0};
+  if (write_bin) {
+    FILE *out_bin = file_open(filename, ".bin");
+    if (!out_bin || !bin_writer_begin(&bin, out_bin, bin_layout,
+          coord_pair_count)) {
+      fprintf(stderr, "Error: failed to write binary file\n");
+      return 1;
+    }
+  }
+
   srand((u32)seed); // TODO: use better rand
 
   // If we just pick random points on the sphere final harvestine distance
@@ -97,9 +206,23 @@ int main(int argc, char **argv) {
     fprintf(out_json, "    {\"x0\": %.17f, \"y0\": %.17f, "
         "\"x1\": %.17f, \"y1\": %.17f}%s", x0, y0, x1, y1, separator);
     fprintf(out_dists, "%f\n", dist);
+
+    f64 coords[4] = {x0, y0, x1, y1};
+    if (bin.f && !bin_writer_push(&bin, coords)) {
+      fprintf(stderr, "Error: failed to write binary file\n");
+      return 1;
+    }
   }
   fprintf(out_json, "  ]\n}\n");
 
+  if (bin.f) {
+    if (!bin_writer_end(&bin)) {
+      fprintf(stderr, "Error: failed to write binary file\n");
+      return 1;
+    }
+    fclose(bin.f);
+  }
+
   fprintf(out_avg, "%.17f\n", avg);
 
   fclose(out_json);
@@ -6,11 +6,16 @@
 
 // TODO:
 // Performance roadmap
+//
+// Parser stats are from a single `harvestine --bench` run, minimum over
+// repetitions on 500k pairs (56.84 MB json), profiler compiled out, x86_64
+// 2 GHz, fixed key order fast path on. Run to run noise on this machine is
+// 10-25%, bigger than any difference between predictive parsers below.
 
 // * Baseline
 //
 // Stats
-// <bench_stat>
+// baseline    102.5 ms  0.542 GB/s  1.00x
 //
 // * Optimisation 1: eliminate buf deref checks
 // At the moment I always check if we are still within [buf->data, buf->end)
@@ -21,64 +26,92 @@
 //
 // Allocate some extra space at the end of the buffer and fill it in with EOF.
 // They we can deref past file content and just fail char or string comparison.
+// Done: JSON_BUF_PADDING, parse_coords_json_sentinel() (--parser=sentinel)
 //
 // Stats
-// <bench_stat>
+// sentinel    105.2 ms  0.527 GB/s  0.97x
 //
 // * Optimization 2:
 // Rewrite is_whitespace
-// #define OPT_IS_WHITESPACE
+// Done: CLASSIFY_BRANCHLESS and CLASSIFY_LUT (--parser=branchless, lut).
+// LUT is s_char_class table, also used by accept_char() and by
+// is_number_start(). Generated json has one space per token, so
+// whitespace check is a small part of parse_pair(), all three are within
+// noise.
 //
 // Stats
-// <bench_stat>
+// branchless  109.0 ms  0.509 GB/s  0.94x
+// lut         104.9 ms  0.529 GB/s  0.98x
 //
-// * Optimization 2:
+// * Optimization 3:
 // Rewrite is_pairs
-// #define OPT_IS_PAIRS
+// Done: is_pairs() with CLASSIFY_BRANCHLESS. Runs once per file, no stats.
 //
 // * Optimization 4:
 // Rewrite strtod(). strtod() uses isspace() and acceses locale
+// Done: parse_f64.h (Clinger + Eisel-Lemire, strtod() fallback)
 //
-// Stats
-// <bench_stat>
+// Stats (parse_f64_bench, 1M numbers)
+// strtod      161.6 ms  0.132 GB/s
+// parse_f64    53.7 ms  0.397 GB/s  3.01x
 //
 // * Optimization 5:
 // Filter out all the whitespaces
+// Tried: json_scan.h index of structural characters, parse_coords_json_simd()
+// Stage 1 (SIMD classification and index) takes ~27 ms, stage 2 alone costs
+// as much as the whole baseline parser: parse_f64() dominates both, and
+// fixed key order fast path already skips keys and single spaces with 8 byte
+// compares. Whitespace is not the bottleneck of this input, so stage 1 is
+// pure overhead. Not selectable with --parser, kept as experimental entry of
+// --bench.
 //
 // Stats
-// <bench_stat>
+// simd        133.3 ms  0.416 GB/s  0.77x
 
 #define PROFILER_ENABLED
 
-// Profiler intrusive level:
+// Main thread, PARSE_THREAD_COUNT_MAX parse workers, DIST_THREAD_COUNT_MAX
+// distance workers and pipeline reader
+#define PROFILER_THREADS_SIZE_MAX 130
+
+// Profiler intrusive levels, enabled at runtime with --profile=<lvls> or
+// HARVESTINE_PROFILE environment variable:
 // 0 - not intrusive, only high level functions
 // 1 - some parser functions
 // 2 - all functions
-#define PROFILER_LEVEL 1
-
-#if PROFILER_LEVEL >= 2
-    #define PROFILE_FUNC_LVL1(b) PROFILE_FUNC(b)
-    #define PROFILE_FUNC_LVL2(b) PROFILE_FUNC(b)
-#elif PROFILER_LEVEL == 1
-    #define PROFILE_FUNC_LVL1(b) PROFILE_FUNC(b)
-    #define PROFILE_FUNC_LVL2(b)
-#elif PROFILER_LEVEL == 0
-    #define PROFILE_FUNC_LVL1(b)
-    #define PROFILE_FUNC_LVL2(b)
-#endif
+#define PROFILE_FUNC_LVL1(b) PROFILE_FUNC_LEVEL(1, b)
+#define PROFILE_FUNC_LVL2(b) PROFILE_FUNC_LEVEL(2, b)
+
+// Levels 0 and 1
+#define PROFILER_LEVEL_MASK_DEFAULT 0x3u
 
 // Begin unity build
+#include "os.c"
 #include "timer.c"
 #include "profiler.c"
+#include "json_scan.c"
+#include "calc_harvestine_simd.c"
+#include "tester.c"
 // End unity build
 
 #include "types.h"
+#include "os.h"
 #include "timer.h"
+#include "profiler.h"
 #include "calc_harvestine.h"
-
-#include <stdio.h>      // printf fprintf fopen fread
-#include <stdlib.h>     // malloc free strtod
-#include <string.h>     // strncmp
+#include "calc_harvestine_simd.h"
+#include "coords_bin.h"
+#include "parse_f64.h"
+#include "format_f64.h"
+#include "json_scan.h"
+#include "tester.h"
+
+#include <assert.h>     // static_assert
+#include <stdarg.h>     // va_list va_start va_end
+#include <stdatomic.h>  // atomic_load_explicit atomic_store_explicit
+#include <stdio.h>      // printf fprintf fopen fread vsnprintf
+#include <stdlib.h>     // malloc calloc realloc free atol getenv
+#include <string.h>     // strncmp memcmp memcpy strchr strlen
 #include <sys/stat.h>   // stat
 
 struct buf_u8 {
@@ -92,20 +125,112 @@ struct sv {
   u32 size;
 };
 
-enum {COORDS_SIZE_MAX = 10 * 4 * 1024 * 1024};
+// Growable array of coordinates.
+// Address space is reserved upfront and pages are committed as the array
+// grows, so data never moves and there are no realloc copies. Input size is
+// only limited by address space.
+//
+// Layouts:
+// * AoS: x0 y0 x1 y1 records at `data`
+// * SoA: x0[] y0[] x1[] y1[] columns, every column gets a quarter of
+//   reserved address space, column i starts at `data + i * column_stride`.
+//   Columns are huge page aligned.
+#define COORDS_RESERVE_SIZE   (1LLU << 40)        // 1 TB
+#define COORDS_COMMIT_SIZE    (64LLU << 20)       // 64 MB
+#define COORDS_HUGE_PAGE_SIZE (2LLU << 20)        // 2 MB
 
 struct coords {
-  f64 data[COORDS_SIZE_MAX];
-  u64 size;
+  f64 *data;
+  u64 column_stride; // SoA: f64 count between columns, AoS: 0
+  u64 size;         // f64 count of all columns
+  u64 capacity;     // committed f64 count of all columns
+  u8 *reserve;      // reserved address space
+  u64 reserve_size;
+};
+
+// How input file gets into memory
+enum input_mode {
+  INPUT_MODE_FREAD,   // read whole file into malloc'ed buffer
+  INPUT_MODE_MMAP,    // memory map file and parse directly from the map
+  INPUT_MODE_STREAM,  // read file in chunks, parse and calculate on the go
+  INPUT_MODE_PIPELINE,// same as stream, but read chunks on a reader thread
+  INPUT_MODE_BIN,     // memory map binary coordinates file, no parsing
+
+  INPUT_MODE_COUNT,
+};
+
+// Precision of distance calculation
+enum precision {
+  PRECISION_F64,  // calc_harvestine()
+  PRECISION_F32,  // calc_harvestine_f32(), coordinates are rounded to f32
+
+  PRECISION_COUNT,
+};
+
+static const char * const s_precision_names[PRECISION_COUNT] = {
+  "f64",
+  "f32",
+};
+
+static const char * const s_input_mode_names[INPUT_MODE_COUNT] = {
+  "fread",
+  "mmap",
+  "stream",
+  "pipeline",
+  "bin",
+};
+
+// Pairs parsed by parse_pair() and how many of them didn't match fixed key
+// order fast path
+struct parse_stats {
+  u64 pair_count;
+  u64 fallback_count;
+};
+
+// The first parse error. Parser stops at it, message is formatted right
+// away, line, column and excerpt only when it's printed.
+struct parse_error {
+  u8 *pos;          // 0 - no error
+  char msg[96];
 };
 
 // Predictive parser helper data
 struct walk {
   struct buf_u8 buf;
   u8 *cur;
+  struct parse_stats stats;
+  struct parse_error error;
+};
+
+// File buffers (fread and mmap input modes) are followed by JSON_BUF_PADDING
+// zero bytes. Zero is neither a whitespace nor any character that parser
+// accepts, so scanning loops stop at it without checking for the buffer end.
+enum {JSON_BUF_PADDING = 64};
+
+// Predictive parser variant. Parser functions are FORCE_INLINE and every
+// entry point passes constant options, so each entry point gets its own copy
+// of the parser without unused branches.
+// How parser tells whitespace and "pairs" key apart
+enum classify_mode {
+  CLASSIFY_SWITCH,      // switch over chars, strncmp()
+  CLASSIFY_BRANCHLESS,  // OR of char compares, AND of key char compares
+  CLASSIFY_LUT,         // 256 entry char class table
+};
+
+// Parser entry points pass compile time constant options to FORCE_INLINE
+// parser functions, so every combination is compiled into its own loop.
+struct parse_opts {
+  b32 sentinel;   // rely on JSON_BUF_PADDING instead of bounds checks
+  enum classify_mode classify;
 };
 
 static struct coords s_coords;
+static struct parse_stats s_parse_stats;
+
+static void parse_stats_add(struct parse_stats stats) {
+  s_parse_stats.pair_count      += stats.pair_count;
+  s_parse_stats.fallback_count  += stats.fallback_count;
+}
 
 // --------------------------------------
 // File IO
@@ -141,7 +266,7 @@ static struct buf_u8 alloc_buf_file_read(const char *filepath) {
     goto file_read_failed;
   }
 
-  buf = malloc(file_size);
+  buf = malloc(file_size + JSON_BUF_PADDING);
   if (!buf) {
     perror("Error: malloc failed");
     goto file_read_failed;
@@ -156,6 +281,8 @@ static struct buf_u8 alloc_buf_file_read(const char *filepath) {
     goto file_read_failed;
   }
 
+  memset(buf + file_size, 0, JSON_BUF_PADDING);
+
   ret.data = buf;
   ret.end = buf + file_size;
 
@@ -171,44 +298,504 @@ file_read_failed:
   goto file_read_cleanup;
 }
 
+// Memory map the file, no copy is made. Pages are faulted in by the parser.
+static struct buf_u8 alloc_buf_file_mmap(const char *filepath) {
+  PROFILE_FUNC(0);
+
+  struct buf_u8 ret = {0};
+
+  PROFILE_ZONE_BEGIN("mmap", 0);
+  struct os_buf map = os_file_mmap_padded(filepath, JSON_BUF_PADDING);
+  PROFILE_ZONE_END();
+
+  if (!map.data) {
+    perror("Error: os_file_mmap_padded() failed");
+    return ret;
+  }
+
+  // Parser walks the file front to back exactly once
+  if (!os_virtual_advise_sequential(map.data, map.size)) {
+    perror("Warning: os_virtual_advise_sequential() failed");
+  }
+
+  ret.data = map.data;
+  ret.end = ret.data + map.size;
+  return ret;
+}
+
+static struct buf_u8 alloc_buf_file(const char *filepath,
+    enum input_mode mode) {
+  switch (mode) {
+    case INPUT_MODE_FREAD:  return alloc_buf_file_read(filepath);
+    case INPUT_MODE_MMAP:   return alloc_buf_file_mmap(filepath);
+    case INPUT_MODE_STREAM:
+    case INPUT_MODE_PIPELINE:
+    case INPUT_MODE_BIN:
+    case INPUT_MODE_COUNT:  break;
+  }
+  return (struct buf_u8){0};
+}
+
+static void free_buf_file(struct buf_u8 buf, enum input_mode mode) {
+  PROFILE_FUNC(0);
+
+  switch (mode) {
+    case INPUT_MODE_FREAD:
+      free(buf.data);
+      break;
+    case INPUT_MODE_MMAP:
+      os_file_munmap_padded((struct os_buf){buf.data, buf.end - buf.data},
+          JSON_BUF_PADDING);
+      break;
+    case INPUT_MODE_STREAM:
+    case INPUT_MODE_PIPELINE:
+    case INPUT_MODE_BIN:
+    case INPUT_MODE_COUNT:
+      break;
+  }
+}
+
+// --------------------------------------
+// Coordinates storage
+// --------------------------------------
+
+// Reserve address space for coordinates.
+// With `huge_pages` committed memory is backed by huge pages if OS allows.
+// Returns 0 on failure.
+static b32 coords_init(struct coords *c, enum coords_bin_layout layout,
+    b32 huge_pages) {
+  PROFILE_FUNC(0);
+
+  // Extra huge page to align data to huge page boundary
+  u64 reserve_size = COORDS_RESERVE_SIZE + COORDS_HUGE_PAGE_SIZE;
+  u8 *reserve = os_virtual_reserve(reserve_size);
+  if (!reserve) {
+    perror("Error: os_virtual_reserve() failed");
+    return 0;
+  }
+
+  u64 align_mask = COORDS_HUGE_PAGE_SIZE - 1;
+  u8 *data = (u8 *)(((u64)reserve + align_mask) & ~align_mask);
+  if (huge_pages
+      && !os_virtual_advise_huge_pages(data, COORDS_RESERVE_SIZE)) {
+    perror("Warning: os_virtual_advise_huge_pages() failed");
+  }
+
+  *c = (struct coords){
+    .data = (f64 *)data,
+    .column_stride = layout == COORDS_BIN_LAYOUT_SOA
+      ? COORDS_RESERVE_SIZE / 4 / sizeof(f64)
+      : 0,
+    .reserve = reserve,
+    .reserve_size = reserve_size,
+  };
+  return 1;
+}
+
+static void coords_free(struct coords *c) {
+  PROFILE_FUNC(0);
+  if (c->reserve) {
+    os_virtual_free(c->reserve, c->reserve_size);
+  }
+  *c = (struct coords){0};
+}
+
+// Commit pages for at least `count` more coordinates.
+// Returns 0 if out of reserved address space or commit failed.
+static b32 coords_grow(struct coords *c, u64 count) {
+  PROFILE_FUNC(0);
+
+  u64 commit_count = COORDS_COMMIT_SIZE / sizeof(f64);
+  u64 new_capacity = (c->size + count + commit_count - 1)
+    / commit_count * commit_count;
+  if (new_capacity > COORDS_RESERVE_SIZE / sizeof(f64)) {
+    fprintf(stderr, "Error: not enough memory to store coordinates\n");
+    return 0;
+  }
+
+  if (new_capacity > c->capacity) {
+    b32 committed = true;
+    if (c->column_stride) {
+      for (u32 i = 0; i < 4 && committed; ++i) {
+        committed = os_virtual_commit(
+            c->data + i * c->column_stride + c->capacity / 4,
+            (new_capacity - c->capacity) / 4 * sizeof(f64));
+      }
+    } else {
+      committed = os_virtual_commit(c->data + c->capacity,
+          (new_capacity - c->capacity) * sizeof(f64));
+    }
+    if (!committed) {
+      perror("Error: os_virtual_commit() failed");
+      return 0;
+    }
+    c->capacity = new_capacity;
+  }
+  return 1;
+}
+
+// Append x0 y0 x1 y1.
+// Returns 0 on failure.
+static FORCE_INLINE b32 coords_push_pair(struct coords *c,
+    const f64 coords[4]) {
+  if (UNLIKELY(c->size + 4 > c->capacity) && !coords_grow(c, 4)) {
+    return 0;
+  }
+  if (c->column_stride) {
+    u64 pair_index = c->size / 4;
+    c->data[0 * c->column_stride + pair_index] = coords[0];
+    c->data[1 * c->column_stride + pair_index] = coords[1];
+    c->data[2 * c->column_stride + pair_index] = coords[2];
+    c->data[3 * c->column_stride + pair_index] = coords[3];
+  } else {
+    memcpy(c->data + c->size, coords, 4 * sizeof(f64));
+  }
+  c->size += 4;
+  return 1;
+}
+
+// --------------------------------------
+// Binary coordinates file
+// --------------------------------------
+
+// Memory mapped binary coordinates file, see coords_bin.h
+struct coords_bin {
+  struct os_buf map;
+  struct coords_bin_header header;
+  const f64 *data;
+};
+
+// Map and validate binary coordinates file. Coordinates are used directly
+// from the map.
+// Returns 0 on failure.
+static b32 load_coords_bin(const char *filepath, struct coords_bin *out_bin) {
+  PROFILE_FUNC(0);
+
+  PROFILE_ZONE_BEGIN("mmap", 0);
+  struct os_buf map = os_file_mmap(filepath);
+  PROFILE_ZONE_END();
+
+  if (!map.data) {
+    perror("Error: os_file_mmap() failed");
+    return 0;
+  }
+
+  struct coords_bin_header h = {0};
+  if (map.size >= sizeof(h)) {
+    memcpy(&h, map.data, sizeof(h));
+  }
+
+  const char *error = 0;
+  if (map.size < sizeof(h) || h.magic != COORDS_BIN_MAGIC) {
+    error = "not a binary coordinates file";
+  } else if (h.version != COORDS_BIN_VERSION) {
+    error = "unsupported version";
+  } else if (h.layout >= COORDS_BIN_LAYOUT_COUNT
+      || h.data_offset % COORDS_BIN_ALIGN
+      || h.column_stride % COORDS_BIN_ALIGN
+      || h.pair_count > map.size / (4 * sizeof(f64))
+      || (h.layout == COORDS_BIN_LAYOUT_SOA
+        && h.column_stride < h.pair_count * sizeof(f64))
+      || h.data_offset > map.size
+      || h.column_stride > map.size
+      || coords_bin_file_size(&h) != map.size) {
+    error = "corrupted header";
+  }
+
+  if (!error) {
+    // Parser walks the file front to back exactly once
+    if (!os_virtual_advise_sequential(map.data, map.size)) {
+      perror("Warning: os_virtual_advise_sequential() failed");
+    }
+
+    const f64 *data = (const f64 *)((u8 *)map.data + h.data_offset);
+
+    PROFILE_ZONE_BEGIN("coords_bin_checksum", h.pair_count * 4 * sizeof(f64));
+    u64 checksum = COORDS_BIN_HASH_SEED;
+    if (h.layout == COORDS_BIN_LAYOUT_SOA) {
+      u64 stride = h.column_stride / sizeof(f64);
+      for (u32 i = 0; i < 4; ++i) {
+        checksum = coords_bin_hash(checksum, data + i * stride, h.pair_count);
+      }
+    } else {
+      checksum = coords_bin_hash(checksum, data, h.pair_count * 4);
+    }
+    PROFILE_ZONE_END();
+
+    if (checksum != h.checksum) {
+      error = "checksum mismatch";
+    }
+
+    *out_bin = (struct coords_bin){map, h, data};
+  }
+
+  if (error) {
+    fprintf(stderr, "Error: '%s': %s\n", filepath, error);
+    os_file_munmap(map);
+    return 0;
+  }
+  return 1;
+}
+
+static void unload_coords_bin(struct coords_bin bin) {
+  PROFILE_FUNC(0);
+  os_file_munmap(bin.map);
+}
+
+// Write binary coordinates file in the same layout as `coords`.
+// Returns 0 on failure.
+static b32 write_coords_bin(const char *filepath,
+    const struct coords *coords) {
+  u64 pair_count = coords->size / 4;
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  u64 stride = coords->column_stride;
+  struct coords_bin_header h = coords_bin_header_make(
+      stride ? COORDS_BIN_LAYOUT_SOA : COORDS_BIN_LAYOUT_AOS, pair_count);
+
+  PROFILE_ZONE_BEGIN("coords_bin_checksum", pair_count * 4 * sizeof(f64));
+  h.checksum = COORDS_BIN_HASH_SEED;
+  if (stride) {
+    for (u32 i = 0; i < 4; ++i) {
+      h.checksum = coords_bin_hash(h.checksum, coords->data + i * stride,
+          pair_count);
+    }
+  } else {
+    h.checksum = coords_bin_hash(h.checksum, coords->data, pair_count * 4);
+  }
+  PROFILE_ZONE_END();
+
+  FILE *f = fopen(filepath, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: failed to open file '%s'", filepath);
+    perror("");
+    return 0;
+  }
+
+  u8 header[COORDS_BIN_ALIGN] = {0};
+  memcpy(header, &h, sizeof(h));
+
+  b32 ret = fwrite(header, 1, h.data_offset, f) == h.data_offset;
+  if (stride) {
+    // Columns are padded up to `column_stride` in the file
+    const u8 zeros[COORDS_BIN_ALIGN] = {0};
+    u64 pad = h.column_stride - pair_count * sizeof(f64);
+    for (u32 i = 0; i < 4 && ret; ++i) {
+      ret = fwrite(coords->data + i * stride, sizeof(f64), pair_count, f)
+          == pair_count
+        && (i == 3 || fwrite(zeros, 1, pad, f) == pad);
+    }
+  } else {
+    ret = ret
+      && fwrite(coords->data, 4 * sizeof(f64), pair_count, f) == pair_count;
+  }
+  ret = !fclose(f) && ret;
+  if (!ret) {
+    fprintf(stderr, "Error: failed to write file '%s'", filepath);
+    perror("");
+  }
+  return ret;
+}
+
+// --------------------------------------
+// Parse errors
+// --------------------------------------
+
+// Errors are rare, everything here is out of line and cold, so parser loops
+// only keep a single not taken branch per check.
+
+static void parse_error_vset(struct parse_error *err, u8 *pos,
+    const char *fmt, va_list args) {
+  if (err->pos) {
+    return; // keep the first error
+  }
+  err->pos = pos;
+  vsnprintf(err->msg, sizeof(err->msg), fmt, args);
+}
+
+__attribute__((cold, noinline, format(printf, 3, 4)))
+static void parse_error_set(struct parse_error *err, u8 *pos,
+    const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  parse_error_vset(err, pos, fmt, args);
+  va_end(args);
+}
+
+// Print `err` with the line around it and a caret under the error position.
+// [begin, end) is the parsed text in memory, that starts at `begin_offset`
+// bytes into the file. Line and column are counted from `begin` only if it's
+// the beginning of the file, otherwise only byte offset is known.
+__attribute__((cold, noinline))
+static void parse_error_print(const struct parse_error *err, const u8 *begin,
+    const u8 *end, u64 begin_offset) {
+  enum {EXCERPT_HALF_SIZE = 40};
+
+  const u8 *pos = MIN(err->pos, end);
+  u64 offset = begin_offset + (pos - begin);
+  if (begin_offset == 0) {
+    u64 line = 1;
+    const u8 *line_begin = begin;
+    for (const u8 *p = begin; p < pos; ++p) {
+      if (*p == '\n') {
+        ++line;
+        line_begin = p + 1;
+      }
+    }
+    fprintf(stderr, "Parser error: line %llu, column %llu (position %llu): "
+        "%s\n", line, (u64)(pos - line_begin) + 1, offset, err->msg);
+  } else {
+    fprintf(stderr, "Parser error: position %llu: %s\n", offset, err->msg);
+  }
+
+  const u8 *l = pos;
+  while (l > begin && pos - l < EXCERPT_HALF_SIZE && l[-1] != '\n') {
+    --l;
+  }
+  const u8 *r = pos;
+  while (r < end && r - pos < EXCERPT_HALF_SIZE && *r != '\n') {
+    ++r;
+  }
+
+  // Tabs and other control chars are printed as spaces to keep the caret
+  // aligned
+  fprintf(stderr, "    ");
+  for (const u8 *p = l; p < r; ++p) {
+    fputc(*p < ' ' ? ' ' : *p, stderr);
+  }
+  fprintf(stderr, "\n    %*c\n", (int)(pos - l) + 1, '^');
+}
+
+// Record error and stop the walk: cursor is moved to the end of the buffer,
+// where nothing is accepted, so the parser unwinds without extra checks.
+__attribute__((cold, noinline, format(printf, 3, 4)))
+static void walk_fail(struct walk *w, u8 *pos, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  parse_error_vset(&w->error, pos, fmt, args);
+  va_end(args);
+  w->cur = w->buf.end;
+}
+
+static void walk_print_error(const struct walk *w) {
+  parse_error_print(&w->error, w->buf.data, w->buf.end, 0);
+}
+
 // --------------------------------------
 // Predictive Parser
 // --------------------------------------
 
-b32 is_whitespace(i32 c) {
+enum char_class {
+  CHAR_CLASS_OTHER = 0,
+  CHAR_CLASS_WHITESPACE,
+  CHAR_CLASS_STRUCTURAL,  // { } [ ] : ,
+  CHAR_CLASS_DIGIT,       // 0-9 and '-', JSON number start
+  CHAR_CLASS_QUOTE,
+};
+
+// Class of every byte, JSON_BUF_PADDING zeros are CHAR_CLASS_OTHER
+static const u8 s_char_class[256] = {
+  [' '] = CHAR_CLASS_WHITESPACE,
+  ['\t'] = CHAR_CLASS_WHITESPACE,
+  ['\n'] = CHAR_CLASS_WHITESPACE,
+  ['\r'] = CHAR_CLASS_WHITESPACE,
+  ['{'] = CHAR_CLASS_STRUCTURAL,
+  ['}'] = CHAR_CLASS_STRUCTURAL,
+  ['['] = CHAR_CLASS_STRUCTURAL,
+  [']'] = CHAR_CLASS_STRUCTURAL,
+  [':'] = CHAR_CLASS_STRUCTURAL,
+  [','] = CHAR_CLASS_STRUCTURAL,
+  ['0'] = CHAR_CLASS_DIGIT,
+  ['1'] = CHAR_CLASS_DIGIT,
+  ['2'] = CHAR_CLASS_DIGIT,
+  ['3'] = CHAR_CLASS_DIGIT,
+  ['4'] = CHAR_CLASS_DIGIT,
+  ['5'] = CHAR_CLASS_DIGIT,
+  ['6'] = CHAR_CLASS_DIGIT,
+  ['7'] = CHAR_CLASS_DIGIT,
+  ['8'] = CHAR_CLASS_DIGIT,
+  ['9'] = CHAR_CLASS_DIGIT,
+  ['-'] = CHAR_CLASS_DIGIT,
+  ['"'] = CHAR_CLASS_QUOTE,
+};
+
+// CLASSIFY_SWITCH also accepts '\v' and '\f' like isspace()
+static FORCE_INLINE b32 is_whitespace(u8 c, struct parse_opts opts) {
   PROFILE_FUNC_LVL2(0);
-#ifndef OPT_IS_WHITESPACE
-  switch(c) {
-    case ' ':
-    case '\t':
-    case '\r':
-    case '\n':
-    case '\v':
-    case '\f':
-    return 1;
+  switch (opts.classify) {
+    case CLASSIFY_SWITCH:
+      switch (c) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case '\v':
+        case '\f':
+        return 1;
+      }
+      return 0;
+
+    case CLASSIFY_BRANCHLESS: {
+      i32 m0 = c == '\n';
+      i32 m1 = c == '\r';
+      i32 m2 = c == ' ';
+      i32 m3 = c == '\t';
+      return m0 | m1 | m2 | m3;
+    }
+
+    case CLASSIFY_LUT:
+      return s_char_class[c] == CHAR_CLASS_WHITESPACE;
+  }
+  return 0;
+}
+
+// JSON number starts with a digit or '-'.
+// parse_f64() also accepts "inf", "nan" and leading '+', JSON doesn't, so
+// every mode checks the first byte before calling it.
+static FORCE_INLINE b32 is_number_start(u8 c, struct parse_opts opts) {
+  switch (opts.classify) {
+    case CLASSIFY_SWITCH:
+      return (c >= '0' && c <= '9') || c == '-';
+
+    case CLASSIFY_BRANCHLESS: {
+      i32 m0 = (u8)(c - '0') < 10;
+      i32 m1 = c == '-';
+      return m0 | m1;
+    }
+
+    case CLASSIFY_LUT:
+      return s_char_class[c] == CHAR_CLASS_DIGIT;
   }
   return 0;
-#else
-  i32 m0 = c == '\n';
-  i32 m1 = c == '\r';
-  i32 m2 = c == ' ';
-  i32 m3 = c == '\t';
-  return m0 | m1 | m2 | m3;
-#endif // #ifndef OPT_IS_WHITESPACE
 }
 
-void skip_whitespace(struct walk *w) {
+static FORCE_INLINE void skip_whitespace(struct walk *w,
+    struct parse_opts opts) {
   PROFILE_FUNC_LVL2(0);
-  while (w->cur < w->buf.end && is_whitespace(*w->cur)) {
+  while ((opts.sentinel || w->cur < w->buf.end)
+      && is_whitespace(*w->cur, opts)) {
     ++w->cur;
   }
 }
 
-b32 accept_char(struct walk * restrict w, i32 c) {
+static FORCE_INLINE b32 accept_char(struct walk * restrict w, i32 c,
+    struct parse_opts opts) {
   PROFILE_FUNC_LVL2(0);
-  skip_whitespace(w);
+  if (opts.classify == CLASSIFY_LUT) {
+    // Tokens mostly follow each other without whitespace: a single load and
+    // lookup decides between compare and skip loop
+    if (!opts.sentinel && w->cur >= w->buf.end) {
+      return 0;
+    }
+    u8 v = *w->cur;
+    if (LIKELY(s_char_class[v] != CHAR_CLASS_WHITESPACE)) {
+      w->cur += v == c;
+      return v == c;
+    }
+  }
+  skip_whitespace(w, opts);
 
-  if (w->cur >= w->buf.end) {
+  if (!opts.sentinel && w->cur >= w->buf.end) {
     return 0;
   }
 
@@ -219,48 +806,66 @@ b32 accept_char(struct walk * restrict w, i32 c) {
   return 0;
 }
 
-b32 accept_sv(struct walk * restrict w, struct sv * restrict out_key) {
+static FORCE_INLINE b32 accept_sv(struct walk * restrict w,
+    struct sv * restrict out_key, struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
-  skip_whitespace(w);
+  skip_whitespace(w, opts);
 
-  if (!accept_char(w, '"')) {
+  if (!accept_char(w, '"', opts)) {
     return 0;
   }
 
   u8 *cur = w->cur;
   u8 *end = w->buf.end;
-  while (cur < end && *cur++ != '"') {
+  if (opts.sentinel) {
+    // Unterminated string stops at the padding
+    for (u8 c; (c = *cur++) != '"' && c;) {
+    }
+  } else {
+    while (cur < end && *cur++ != '"') {
+    }
   }
 
-  *out_key = (struct sv){(char *)w->cur, cur - w->cur - 1};
-  if (w->cur != cur) {
-    w->cur = cur;
-    return 1;
+  // Unterminated string is not accepted
+  if (cur == w->cur || cur[-1] != '"') {
+    return 0;
   }
-  return 0;
+  *out_key = (struct sv){(char *)w->cur, cur - w->cur - 1};
+  w->cur = cur;
+  return 1;
 }
 
-b32 accept_f64(struct walk * restrict w, f64 * restrict out_d) {
+static FORCE_INLINE b32 accept_f64(struct walk * restrict w,
+    f64 * restrict out_d, struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
-  skip_whitespace(w);
+  skip_whitespace(w, opts);
 
-  u8 *end;
-  f64 d = strtod((char *)w->cur, (char **)&end);
+  if ((!opts.sentinel && w->cur >= w->buf.end)
+      || !is_number_start(*w->cur, opts)) {
+    return 0;
+  }
+
+  u8 *end = parse_f64(w->cur, out_d);
   if (end != w->cur) {
       w->cur = end;
-      *out_d = d;
       return 1;
   }
   return 0;
 }
 
-b32 accept_any_to_char(struct walk * restrict w, i32 c) {
+static FORCE_INLINE b32 accept_any_to_char(struct walk * restrict w, i32 c,
+    struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
-  skip_whitespace(w);
+  skip_whitespace(w, opts);
 
   u8 *cur = w->cur;
   u8 *end = w->buf.end;
-  while (cur < end && *cur++ != c) {
+  if (opts.sentinel) {
+    for (u8 v; (v = *cur++) != c && v;) {
+    }
+  } else {
+    while (cur < end && *cur++ != c) {
+    }
   }
 
   if (w->cur != cur) {
@@ -270,28 +875,43 @@ b32 accept_any_to_char(struct walk * restrict w, i32 c) {
   return 0;
 }
 
-b32 expect_char(struct walk * restrict w, i32 c) {
+static FORCE_INLINE b32 expect_char(struct walk * restrict w, i32 c,
+    struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
-  if (accept_char(w, c)) {
+  if (LIKELY(accept_char(w, c, opts))) {
     return 1;
   }
-  fprintf(stderr, "Perser error: expected '%c' at position %lu, got '%c'\n",
-      c, w->cur - w->buf.data, *w->cur);
+  if (w->cur < w->buf.end) {
+    walk_fail(w, w->cur, "expected '%c', got '%c'", c, *w->cur);
+  } else {
+    walk_fail(w, w->cur, "expected '%c', got end of file", c);
+  }
   return 0;
 }
 
-b32 expect_f64(struct walk * restrict w, f64 *d) {
+static FORCE_INLINE b32 expect_f64(struct walk * restrict w, f64 *d,
+    struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
-  if (accept_f64(w, d)) {
+  if (LIKELY(accept_f64(w, d, opts))) {
     return 1;
   }
-  fprintf(stderr, "Perser error: expected f64 at position %lu\n",
-      w->cur - w->buf.data);
+  walk_fail(w, w->cur, "expected f64");
   return 0;
 }
 
-i32 key_to_coord_index(struct sv key) {
+// Key string without quotes
+static FORCE_INLINE b32 expect_key(struct walk * restrict w,
+    struct sv * restrict out_key, struct parse_opts opts) {
   PROFILE_FUNC_LVL1(0);
+  if (LIKELY(accept_sv(w, out_key, opts))) {
+    return 1;
+  }
+  walk_fail(w, w->cur, "expected key");
+  return 0;
+}
+
+i32 key_to_coord_index(struct sv key) {
+  PROFILE_FUNC_LVL2(0);
   // `k + c` should remain negative if either `k` or `c` is not initialized
   // in switch cases below
   i32 k = -32;
@@ -309,142 +929,1958 @@ i32 key_to_coord_index(struct sv key) {
   return k + c;
 }
 
-void print_error_unexpected_key_error(const struct walk *w, struct sv key) {
+// Key without quotes is exactly "pairs"
+static FORCE_INLINE b32 is_pairs(struct sv sv, struct parse_opts opts) {
   PROFILE_FUNC_LVL2(0);
-  i32 pos = w->cur - w->buf.data - key.size;
-  fprintf(stderr, "Perser error: unexpected key \"%.*s\" at position %d.\n\n",
-      key.size, key.data, pos);
-
-  // print surrounding text
-  u8 *w_l = CLAMP(w->cur - key.size - 32, w->buf.data, w->buf.end);
-  u8 *w_r = CLAMP(w->cur - key.size + 48, w->buf.data, w->buf.end);
-
-  // print only surrounding characters that don't mess with a carret position
-  u8 *l = w->cur - key.size;
-  u8 *r = w_r;
-  while (l - 1 >= w_l) {
-    i32 m0 = *l == '\t';
-    i32 m1 = *l == '\r';
-    i32 m2 = *l == '\n';
-    i32 m3 = *l == '\v';
-    if (m0 | m1 | m2 | m3) {
-      goto l_loop_finished;
-    }
-    --l;
+  if (sv.size != 5) {
+    return 0;
+  }
+  if (opts.classify != CLASSIFY_BRANCHLESS) {
+    return strncmp("pairs", sv.data, sv.size) == 0;
   }
-l_loop_finished:
+  i32 m0 = sv.data[0] == 'p';
+  i32 m1 = sv.data[1] == 'a';
+  i32 m2 = sv.data[2] == 'i';
+  i32 m3 = sv.data[3] == 'r';
+  i32 m4 = sv.data[4] == 's';
+  return m0 & m1 & m2 & m3 & m4;
+}
 
-  fprintf(stderr, "    %*c\n", (int)(w->cur - key.size - l), '|');
-  fprintf(stderr, "    %*c\n", (int)(w->cur - key.size - l), 'v');
-  fprintf(stderr, "    %.*s\n\n", (int)(r - l) , l);
+// Returns the first occurrence of `c` in [begin, end) or `end` if not found
+static u8 *find_char(u8 *begin, u8 *end, i32 c) {
+  u8 *cur = begin;
+  while (cur < end && *cur != c) {
+    ++cur;
+  }
+  return cur;
 }
 
-b32 is_pairs(struct sv sv) {
-  PROFILE_FUNC_LVL2(0);
-#ifndef OPT_IS_PAIRS
-  return strncmp("pairs", (char *)sv.data, sv.size) == 0;
-#else
-  if (sv.size != 7) {
-    return 0;
+// Returns the last occurrence of `c` in [begin, end) or `begin` if not found
+static u8 *find_last_char(u8 *begin, u8 *end, i32 c) {
+  u8 *cur = end;
+  while (cur > begin && *--cur != c) {
   }
-  i32 m0 = sv.data[0] == '"';
-  i32 m1 = sv.data[1] == 'p';
-  i32 m2 = sv.data[2] == 'a';
-  i32 m3 = sv.data[3] == 'i';
-  i32 m4 = sv.data[4] == 'r';
-  i32 m5 = sv.data[5] == 's';
-  i32 m6 = sv.data[6] == '"';
-  return m0 | m1 | m2 | m3 | m4 | m5 | m6;
-#endif // #ifndef OPT_IS_PAIRS
+  return cur;
 }
 
-// JSON predictive parser
-b32 parse_coords_json(struct buf_u8 json_buf, struct coords *out_coords) {
-  PROFILE_FUNC(json_buf.end - json_buf.data);
+// Parse json prologue up to the beginning of pairs array: `{"pairs": [`
+static FORCE_INLINE b32 parse_pairs_begin(struct walk * restrict w,
+    struct parse_opts opts) {
+  PROFILE_FUNC_LVL1(0);
 
-  u64 ret_coords_size = 0;
   struct sv key = {0};
-  struct walk w = {json_buf, json_buf.data};
-
-  out_coords->size = ret_coords_size;
-  expect_char(&w, '{');
-
-  accept_sv(&w, &key);
-  if (strncmp("pairs", (char *)key.data, key.size) == 0) {
-    expect_char(&w, ':');
-    expect_char(&w, '[');
-
-    while (!accept_char(&w, ']')) {
-      expect_char(&w, '{');
+  if (!expect_char(w, '{', opts) || !expect_key(w, &key, opts)) {
+    return 0;
+  }
+  if (!is_pairs(key, opts)) {
+    walk_fail(w, (u8 *)key.data, "unexpected key \"%.*s\", expected "
+        "\"pairs\"", key.size, key.data);
+    return 0;
+  }
 
-      f64 coords[4] = {0};
-      while (!accept_char(&w, '}')) {
-        key.data = 0;
-        key.size = 0;
-        accept_sv(&w, &key);
-
-        i32 coord_index = key_to_coord_index(key);
-        if (coord_index < 0) {
-          print_error_unexpected_key_error(&w, key);
-          fprintf(stderr, "Expected keys \"x0\", \"y0\", \"x1\" or \"y1\"\n");
-          return 0;
-        } else {
-          expect_char(&w, ':');
-          expect_f64(&w, &coords[coord_index]);
-          accept_char(&w, ',');
-        }
-      }
-      accept_char(&w, ',');
-
-      if (s_coords.size + 4 < COORDS_SIZE_MAX) {
-        s_coords.data[s_coords.size + 0] = coords[0];
-        s_coords.data[s_coords.size + 1] = coords[1];
-        s_coords.data[s_coords.size + 2] = coords[2];
-        s_coords.data[s_coords.size + 3] = coords[3];
-        s_coords.size += 4;
-      } else {
-        fprintf(stderr, "Error: not enough memory to store coordinates\n");
-        return 0;
-      }
-    }
+  return expect_char(w, ':', opts) && expect_char(w, '[', opts);
+}
 
-  } else {
-    print_error_unexpected_key_error(&w, key);
-    fprintf(stderr, "Expected keys: \"pairs\"");
+// Accept first `size` <= 8 chars of `prefix` with a single 8 byte compare.
+// NOTE: little endian only.
+static FORCE_INLINE b32 accept_prefix8(struct walk * restrict w,
+    const char *prefix, u32 size, struct parse_opts opts) {
+  if (!opts.sentinel && w->buf.end - w->cur < 8) {
     return 0;
   }
 
-  expect_char(&w, '}');
+  u64 v;
+  u64 p;
+  memcpy(&v, w->cur, sizeof(v));
+  memcpy(&p, prefix, sizeof(p));
+  u64 mask = size == 8 ? ~0LLU : (1LLU << size * 8) - 1;
+  if ((v ^ p) & mask) {
+    return 0;
+  }
+  w->cur += size;
   return 1;
 }
 
-// --------------------------------------
-//  Harvestive average
-// --------------------------------------
-
-f64 avg_harvestine_distances(const struct coords *coords) {
-  PROFILE_FUNC(coords->size * sizeof(f64));
+// Speculative parse of a pair object exactly as gen_harvestine writes it:
+// `{"x0": f64, "y0": f64, "x1": f64, "y1": f64}`.
+// Every key with its separators is matched with a single 8 byte compare, no
+// key string is scanned or looked up.
+// Returns 0 and leaves `w` untouched on any mismatch.
+static FORCE_INLINE b32 parse_pair_fixed(struct walk * restrict w,
+    f64 out_coords[4], struct parse_opts opts) {
+  // Padded to 8 bytes with '\0', compared sizes are 7 and 8
+  static const char s_prefixes[4][9] = {
+    "{\"x0\": ",
+    ", \"y0\": ",
+    ", \"x1\": ",
+    ", \"y1\": ",
+  };
+
+  u8 *begin = w->cur;
+  f64 coords[4];
+  for (u32 i = 0; i < 4; ++i) {
+    if (!accept_prefix8(w, s_prefixes[i], i ? 8 : 7, opts)
+        || (!opts.sentinel && w->cur >= w->buf.end)
+        || !is_number_start(*w->cur, opts)) {
+      goto mismatch;
+    }
+    u8 *end = parse_f64(w->cur, coords + i);
+    if (end == w->cur) {
+      goto mismatch;
+    }
+    w->cur = end;
+  }
 
-  f64 avg = 0.0;
-  f64 avg_k = 1.0 * 4.0 / coords->size;
-  for (u64 i = 0; i < coords->size - 3; i += 4) {
-    f64 dist = calc_harvestine(
-        coords->data[i + 0],
-        coords->data[i + 1],
-        coords->data[i + 2],
-        coords->data[i + 3],
-        EARTH_RAD);
-    avg += dist * avg_k;
+  if ((!opts.sentinel && w->cur >= w->buf.end) || *w->cur != '}') {
+    goto mismatch;
   }
+  ++w->cur;
+  memcpy(out_coords, coords, sizeof(coords));
+  return 1;
 
-  return avg;
+mismatch:
+  w->cur = begin;
+  return 0;
 }
 
+// Parse pair object with keys in any order and any whitespace
+static FORCE_INLINE b32 parse_pair_keyed(struct walk * restrict w,
+    f64 out_coords[4], struct parse_opts opts) {
+  struct sv key = {0};
+  if (!expect_char(w, '{', opts)) {
+    return 0;
+  }
+
+  while (!accept_char(w, '}', opts)) {
+    if (!expect_key(w, &key, opts)) {
+      return 0;
+    }
+
+    i32 coord_index = key_to_coord_index(key);
+    if (coord_index < 0) {
+      walk_fail(w, (u8 *)key.data, "unexpected key \"%.*s\", expected "
+          "\"x0\", \"y0\", \"x1\" or \"y1\"", key.size, key.data);
+      return 0;
+    }
+    if (!expect_char(w, ':', opts)
+        || !expect_f64(w, &out_coords[coord_index], opts)) {
+      return 0;
+    }
+    accept_char(w, ',', opts);
+  }
+  return 1;
+}
+
+// Parse one `{"x0": f64, "y0": f64, "x1": f64, "y1": f64}` pair object
+// and optional trailing comma.
+// Tries fixed key order first, falls back to parse_pair_keyed(), counts
+// both in `w->stats`.
+static FORCE_INLINE b32 parse_pair(struct walk * restrict w,
+    f64 out_coords[4], struct parse_opts opts) {
+  PROFILE_FUNC_LVL1(0);
+
+  ++w->stats.pair_count;
+  skip_whitespace(w, opts);
+  if (UNLIKELY(!parse_pair_fixed(w, out_coords, opts))) {
+    ++w->stats.fallback_count;
+    if (!parse_pair_keyed(w, out_coords, opts)) {
+      return 0;
+    }
+  }
+  accept_char(w, ',', opts);
+  return 1;
+}
+
+static FORCE_INLINE b32 parse_coords_json_opts(struct buf_u8 json_buf,
+    struct coords *out_coords, struct parse_opts opts) {
+  struct walk w = {json_buf, json_buf.data, {0}, {0}};
+
+  out_coords->size = 0;
+  if (parse_pairs_begin(&w, opts)) {
+    while (!accept_char(&w, ']', opts)) {
+      f64 coords[4] = {0};
+      if (!parse_pair(&w, coords, opts)) {
+        break;
+      }
+
+      if (!coords_push_pair(out_coords, coords)) {
+        return 0;
+      }
+    }
+    expect_char(&w, '}', opts);
+  }
+  parse_stats_add(w.stats);
+
+  if (UNLIKELY(w.error.pos != 0)) {
+    walk_print_error(&w);
+    return 0;
+  }
+  return 1;
+}
+
+// JSON predictive parser
+b32 parse_coords_json(struct buf_u8 json_buf, struct coords *out_coords) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+  return parse_coords_json_opts(json_buf, out_coords,
+      (struct parse_opts){0});
+}
+
+// JSON predictive parser without bounds checks.
+// `json_buf` should be followed by JSON_BUF_PADDING zero bytes.
+b32 parse_coords_json_sentinel(struct buf_u8 json_buf,
+    struct coords *out_coords) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+  return parse_coords_json_opts(json_buf, out_coords,
+      (struct parse_opts){.sentinel = true});
+}
+
+// JSON predictive parser with branchless whitespace and key checks
+b32 parse_coords_json_branchless(struct buf_u8 json_buf,
+    struct coords *out_coords) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+  return parse_coords_json_opts(json_buf, out_coords,
+      (struct parse_opts){.classify = CLASSIFY_BRANCHLESS});
+}
+
+// JSON predictive parser with whitespace lookup table
+b32 parse_coords_json_lut(struct buf_u8 json_buf, struct coords *out_coords) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+  return parse_coords_json_opts(json_buf, out_coords,
+      (struct parse_opts){.classify = CLASSIFY_LUT});
+}
+
+// --------------------------------------
+// SIMD indexed parser
+// --------------------------------------
+
+// Same grammar as parse_coords_json(), but instead of walking every byte,
+// jumps between positions of structural characters and number starts found
+// by SIMD json scanner (see json_scan.h).
+
+// Token helpers run several times per pair, so they are level 2 zones
+
+// Returns position of expected char `c` or 0 on failure
+static FORCE_INLINE u8 *scan_expect_char(struct json_scanner *s,
+    struct buf_u8 buf, struct parse_error *err, i32 c) {
+  PROFILE_FUNC_LVL2(0);
+  u8 *p = json_scanner_next(s);
+  if (LIKELY(p && *p == c)) {
+    return p;
+  }
+
+  if (p) {
+    parse_error_set(err, p, "expected '%c', got '%c'", c, *p);
+  } else {
+    parse_error_set(err, buf.end, "expected '%c', got end of file", c);
+  }
+  return 0;
+}
+
+static FORCE_INLINE b32 scan_expect_key(struct json_scanner *s,
+    struct buf_u8 buf, struct parse_error *err, struct sv *out_key) {
+  PROFILE_FUNC_LVL2(0);
+  u8 *open = scan_expect_char(s, buf, err, '"');
+  u8 *close = open ? scan_expect_char(s, buf, err, '"') : 0;
+  if (!close) {
+    return 0;
+  }
+  *out_key = (struct sv){(char *)open + 1, close - open - 1};
+  return 1;
+}
+
+static FORCE_INLINE b32 scan_expect_f64(struct json_scanner *s,
+    struct buf_u8 buf, struct parse_error *err, f64 *out_d) {
+  PROFILE_FUNC_LVL2(0);
+  u8 *p = json_scanner_next(s);
+  if (LIKELY(p && is_number_start(*p, (struct parse_opts){0})
+        && parse_f64(p, out_d) != p)) {
+    return 1;
+  }
+
+  parse_error_set(err, p ? p : buf.end, "expected f64");
+  return 0;
+}
+
+static b32 parse_coords_json_scanned(struct json_scanner *s,
+    struct buf_u8 json_buf, struct coords *out_coords) {
+  json_scanner_init(s, json_buf.data, json_buf.end);
+
+  struct parse_error err = {0};
+  struct sv key = {0};
+  out_coords->size = 0;
+
+  if (!scan_expect_char(s, json_buf, &err, '{')
+      || !scan_expect_key(s, json_buf, &err, &key)) {
+    goto simd_error;
+  }
+  if (!is_pairs(key, (struct parse_opts){0})) {
+    parse_error_set(&err, (u8 *)key.data, "unexpected key \"%.*s\", "
+        "expected \"pairs\"", key.size, key.data);
+    goto simd_error;
+  }
+  if (!scan_expect_char(s, json_buf, &err, ':')
+      || !scan_expect_char(s, json_buf, &err, '[')) {
+    goto simd_error;
+  }
+
+  u8 *p = json_scanner_next(s);
+  while (p && *p == '{') {
+    f64 coords[4] = {0};
+    do {
+      if (!scan_expect_key(s, json_buf, &err, &key)) {
+        goto simd_error;
+      }
+
+      i32 coord_index = key_to_coord_index(key);
+      if (coord_index < 0) {
+        parse_error_set(&err, (u8 *)key.data, "unexpected key \"%.*s\", "
+            "expected \"x0\", \"y0\", \"x1\" or \"y1\"",
+            key.size, key.data);
+        goto simd_error;
+      }
+
+      if (!scan_expect_char(s, json_buf, &err, ':')
+          || !scan_expect_f64(s, json_buf, &err, &coords[coord_index])) {
+        goto simd_error;
+      }
+
+      p = json_scanner_next(s);
+    } while (p && *p == ',');
+
+    if (!p || *p != '}') {
+      parse_error_set(&err, p ? p : json_buf.end, "expected '}'");
+      goto simd_error;
+    }
+
+    if (!coords_push_pair(out_coords, coords)) {
+      return 0;
+    }
+
+    p = json_scanner_next(s);
+    if (p && *p == ',') {
+      p = json_scanner_next(s);
+    }
+  }
+
+  if (!p || *p != ']') {
+    parse_error_set(&err, p ? p : json_buf.end, "expected ']'");
+    goto simd_error;
+  }
+
+  if (scan_expect_char(s, json_buf, &err, '}')) {
+    return 1;
+  }
+
+simd_error:
+  parse_error_print(&err, json_buf.data, json_buf.end, 0);
+  return 0;
+}
+
+b32 parse_coords_json_simd(struct buf_u8 json_buf, struct coords *out_coords) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+
+  // Too large for the stack
+  struct json_scanner *s = malloc(sizeof(*s));
+  if (!s) {
+    fprintf(stderr, "Error: failed to allocate json scanner\n");
+    return 0;
+  }
+
+  b32 ret = parse_coords_json_scanned(s, json_buf, out_coords);
+  free(s);
+  return ret;
+}
+
+// --------------------------------------
+// Parallel parser
+// --------------------------------------
+
+// Pairs array is split into slices at pair object boundaries, every slice is
+// parsed on its own thread into its own coordinates buffer. Buffers are merged
+// in order afterwards, so the result is identical to parse_coords_json().
+enum {
+  PARSE_THREAD_COUNT_MAX = 64,
+  // Smallest pair object with all keys `{"x0":0,"y0":0,"x1":0,"y1":0}`,
+  // initial estimate of the number of pairs in a slice. Pairs with missing
+  // keys, e.g. `{}`, are smaller, worker buffer grows for them.
+  PAIR_JSON_SIZE_MIN = 29,
+};
+
+struct parse_worker {
+  struct buf_u8 buf;      // slice of complete pair objects
+  f64 *coords;
+  u64 coords_size;
+  u64 coords_capacity;
+  struct parse_stats stats;
+  struct parse_error error;
+  b32 parsed;
+};
+
+static void parse_worker_slice(struct parse_worker *pw) {
+  PROFILE_FUNC(pw->buf.end - pw->buf.data);
+
+  struct parse_opts opts = {0};
+  struct walk w = {pw->buf, pw->buf.data, {0}, {0}};
+  pw->parsed = true;
+  for (;;) {
+    skip_whitespace(&w, opts);
+    if (w.cur >= w.buf.end) {
+      break;
+    }
+
+    f64 coords[4] = {0};
+    if (!parse_pair(&w, coords, opts)) {
+      pw->parsed = false;
+      break;
+    }
+
+    if (pw->coords_size + 4 > pw->coords_capacity) {
+      u64 capacity = pw->coords_capacity * 2;
+      f64 *grown = realloc(pw->coords, capacity * sizeof(f64));
+      if (!grown) {
+        walk_fail(&w, w.cur, "out of memory");
+        pw->parsed = false;
+        break;
+      }
+      pw->coords = grown;
+      pw->coords_capacity = capacity;
+    }
+    memcpy(pw->coords + pw->coords_size, coords, sizeof(coords));
+    pw->coords_size += 4;
+  }
+
+  pw->stats = w.stats;
+  pw->error = w.error;
+}
+
+static void *parse_worker_run(void *arg) {
+  PROFILER_THREAD_BEGIN("parse_worker");
+  parse_worker_slice(arg);
+  PROFILER_THREAD_END();
+  return 0;
+}
+
+// Parse json on `thread_count` threads.
+b32 parse_coords_json_parallel(struct buf_u8 json_buf,
+    struct coords *out_coords, u32 thread_count) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+
+  b32 ret = 0;
+  struct parse_opts opts = {0};
+  struct parse_worker workers[PARSE_THREAD_COUNT_MAX] = {0};
+  struct os_thread threads[PARSE_THREAD_COUNT_MAX] = {0};
+  u32 started_count = 0;
+
+  struct walk w = {json_buf, json_buf.data, {0}, {0}};
+  out_coords->size = 0;
+  if (!parse_pairs_begin(&w, opts)) {
+    walk_print_error(&w);
+    return 0;
+  }
+
+  u8 *pairs_begin = w.cur;
+  u8 *pairs_end = find_last_char(pairs_begin, json_buf.end, ']');
+  if (*pairs_end != ']') {
+    pairs_end = json_buf.end; // let workers find where it is broken
+  }
+  u64 pairs_size = pairs_end - pairs_begin;
+
+  // Split into slices that start at `{` of a pair object
+  u8 *slice_begin = pairs_begin;
+  for (u32 i = 0; i < thread_count; ++i) {
+    u8 *slice_end = pairs_begin + pairs_size * (i + 1) / thread_count;
+    slice_end = find_char(MAX(slice_begin, slice_end), pairs_end, '{');
+
+    struct parse_worker *pw = workers + i;
+    pw->buf = (struct buf_u8){slice_begin, slice_end};
+    pw->coords_capacity =
+      ((slice_end - slice_begin) / PAIR_JSON_SIZE_MIN + 1) * 4;
+    pw->coords = malloc(pw->coords_capacity * sizeof(f64));
+    if (!pw->coords) {
+      perror("Error: malloc failed");
+      goto parallel_cleanup;
+    }
+    slice_begin = slice_end;
+  }
+
+  for (; started_count < thread_count; ++started_count) {
+    struct os_thread *thread = threads + started_count;
+    if (!os_thread_start(thread, parse_worker_run, workers + started_count)) {
+      perror("Error: os_thread_start() failed");
+      goto parallel_cleanup;
+    }
+  }
+
+  PROFILE_ZONE_BEGIN_V("parse_workers_join", 0, join_zone);
+  for (u32 i = 0; i < started_count; ++i) {
+    os_thread_join(threads[i]);
+  }
+  started_count = 0;
+  PROFILE_ZONE_END_V(join_zone);
+
+  u64 coords_size = 0;
+  b32 parsed = true;
+  for (u32 i = 0; i < thread_count; ++i) {
+    coords_size   += workers[i].coords_size;
+    parsed        &= workers[i].parsed;
+    parse_stats_add(workers[i].stats);
+  }
+
+  if (!parsed) {
+    // Report the first error in text order
+    for (u32 i = 0; i < thread_count; ++i) {
+      if (!workers[i].parsed) {
+        parse_error_print(&workers[i].error, json_buf.data, json_buf.end, 0);
+        break;
+      }
+    }
+    goto parallel_cleanup;
+  }
+  if (!coords_grow(out_coords, coords_size)) {
+    goto parallel_cleanup;
+  }
+
+  // Merge slices in order
+  PROFILE_ZONE_BEGIN_V("parse_workers_merge", coords_size * sizeof(f64),
+      merge_zone);
+  for (u32 i = 0; i < thread_count; ++i) {
+    struct parse_worker *pw = workers + i;
+    if (out_coords->column_stride) {
+      for (u64 j = 0; j < pw->coords_size; j += 4) {
+        coords_push_pair(out_coords, pw->coords + j);
+      }
+    } else {
+      memcpy(out_coords->data + out_coords->size, pw->coords,
+          pw->coords_size * sizeof(f64));
+      out_coords->size += pw->coords_size;
+    }
+  }
+  PROFILE_ZONE_END_V(merge_zone);
+
+  // Pairs array end was only guessed by the last `]`
+  w.cur = pairs_end;
+  ret = expect_char(&w, ']', opts) && expect_char(&w, '}', opts);
+  if (!ret) {
+    walk_print_error(&w);
+  }
+
+parallel_cleanup:
+  for (u32 i = 0; i < started_count; ++i) {
+    os_thread_join(threads[i]);
+  }
+  for (u32 i = 0; i < thread_count; ++i) {
+    free(workers[i].coords);
+  }
+  return ret;
+}
+
+// --------------------------------------
+//  Harvestive average
+// --------------------------------------
+
+// `coords` are x0 y0 x1 y1 records (AoS)
+f64 avg_harvestine_distances(const f64 *coords, u64 pair_count) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  f64 avg = 0.0;
+  f64 avg_k = 1.0 / pair_count;
+  for (u64 i = 0; i < pair_count; ++i) {
+    f64 dist = calc_harvestine(
+        coords[i * 4 + 0],
+        coords[i * 4 + 1],
+        coords[i * 4 + 2],
+        coords[i * 4 + 3],
+        EARTH_RAD);
+    avg += dist * avg_k;
+  }
+
+  return avg;
+}
+
+enum {HARVESTINE_LANE_COUNT = 8};
+
+// Coordinates are in separate x0[], y0[], x1[] and y1[] columns (SoA).
+// Pairs are processed in blocks of HARVESTINE_LANE_COUNT: every step of
+// calc_harvestine() runs over the whole block with unit stride loads, so
+// arithmetic is vectorized without shuffles. sin, cos and asin are still
+// libm calls per lane, result is bit identical to avg_harvestine_distances().
+f64 avg_harvestine_distances_soa(const f64 *x0, const f64 *y0,
+    const f64 *x1, const f64 *y1, u64 pair_count) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  enum {L = HARVESTINE_LANE_COUNT};
+
+  f64 avg = 0.0;
+  f64 avg_k = 1.0 / pair_count;
+  u64 i = 0;
+  for (; i + L <= pair_count; i += L) {
+    f64 dlat[L];
+    f64 dlon[L];
+    f64 lat0[L];
+    f64 lat1[L];
+    for (u32 l = 0; l < L; ++l) {
+      dlat[l] = deg2rad(y1[i + l] - y0[i + l]) / 2.0;
+      dlon[l] = deg2rad(x1[i + l] - x0[i + l]) / 2.0;
+      lat0[l] = deg2rad(y0[i + l]);
+      lat1[l] = deg2rad(y1[i + l]);
+    }
+
+    for (u32 l = 0; l < L; ++l) {
+      dlat[l] = sin(dlat[l]);
+      dlon[l] = sin(dlon[l]);
+      lat0[l] = cos(lat0[l]);
+      lat1[l] = cos(lat1[l]);
+    }
+
+    f64 a[L];
+    for (u32 l = 0; l < L; ++l) {
+      a[l] = sqr(dlat[l]) + lat0[l] * lat1[l] * sqr(dlon[l]);
+      a[l] = sqrt(a[l]);
+    }
+
+    for (u32 l = 0; l < L; ++l) {
+      a[l] = asin(a[l]);
+    }
+
+    for (u32 l = 0; l < L; ++l) {
+      f64 dist = EARTH_RAD * (2.0 * a[l]);
+      avg += dist * avg_k;
+    }
+  }
+
+  for (; i < pair_count; ++i) {
+    f64 dist = calc_harvestine(x0[i], y0[i], x1[i], y1[i], EARTH_RAD);
+    avg += dist * avg_k;
+  }
+
+  return avg;
+}
+
+// Pair `i` of AoS (`column_stride` is 0) or SoA coordinates
+static FORCE_INLINE void coords_get_pair(const f64 *data, u64 column_stride,
+    u64 i, f64 out_pair[4]) {
+  for (u64 k = 0; k < 4; ++k) {
+    out_pair[k] = column_stride ? data[k * column_stride + i] : data[i * 4 + k];
+  }
+}
+
+// calc_harvestine_f32() of every pair, summed in f64
+f64 avg_harvestine_distances_f32(const f64 *data, u64 column_stride,
+    u64 pair_count) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  f64 sum = 0.0;
+  for (u64 i = 0; i < pair_count; ++i) {
+    f64 p[4];
+    coords_get_pair(data, column_stride, i, p);
+    sum += calc_harvestine_f32(p[0], p[1], p[2], p[3], EARTH_RAD);
+  }
+  return pair_count ? sum / pair_count : 0.0;
+}
+
+// Runs SIMD kernel over AoS or SoA coordinates, see calc_harvestine_simd.h
+static f64 harvestine_kernel_sum(const struct harvestine_kernel *kernel,
+    enum precision precision, const f64 *data, u64 column_stride,
+    u64 pair_count, f64 *out_dists) {
+  b32 f32 = precision == PRECISION_F32;
+  if (column_stride) {
+    harvestine_sum_soa_func_t *sum = f32 ? kernel->sum_soa_f32
+      : kernel->sum_soa;
+    return sum(data, data + column_stride, data + 2 * column_stride,
+        data + 3 * column_stride, pair_count, EARTH_RAD, out_dists);
+  }
+  harvestine_sum_aos_func_t *sum = f32 ? kernel->sum_aos_f32
+    : kernel->sum_aos;
+  return sum(data, pair_count, EARTH_RAD, out_dists);
+}
+
+// Polynomial SIMD kernel instead of libm calls (see calc_harvestine_simd.h).
+// Distances are summed and divided by the count at the end, result might
+// differ in the last digits from avg_harvestine_distances().
+f64 avg_harvestine_distances_simd(const struct harvestine_kernel *kernel,
+    enum precision precision, const f64 *data, u64 column_stride,
+    u64 pair_count) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  if (!pair_count) {
+    return 0.0;
+  }
+  return harvestine_kernel_sum(kernel, precision, data, column_stride,
+      pair_count, 0) / pair_count;
+}
+
+// AoS if `column_stride` is 0, otherwise SoA with columns `column_stride`
+// f64 apart. `kernel` 0 is libm calc_harvestine().
+static f64 avg_harvestine_distances_layout(
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count) {
+  if (kernel) {
+    return avg_harvestine_distances_simd(kernel, precision, data,
+        column_stride, pair_count);
+  }
+  if (precision == PRECISION_F32) {
+    return avg_harvestine_distances_f32(data, column_stride, pair_count);
+  }
+  if (column_stride) {
+    return avg_harvestine_distances_soa(data, data + column_stride,
+        data + 2 * column_stride, data + 3 * column_stride, pair_count);
+  }
+  return avg_harvestine_distances(data, pair_count);
+}
+
+// --------------------------------------
+// Validation
+// --------------------------------------
+
+// Distance of every pair, the same numbers that are averaged by
+// avg_harvestine_distances_layout()
+static void calc_harvestine_dists(const struct harvestine_kernel *kernel,
+    enum precision precision, const f64 *data, u64 column_stride,
+    u64 pair_count, f64 *out_dists) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  if (kernel) {
+    harvestine_kernel_sum(kernel, precision, data, column_stride, pair_count,
+        out_dists);
+    return;
+  }
+
+  for (u64 i = 0; i < pair_count; ++i) {
+    f64 p[4];
+    coords_get_pair(data, column_stride, i, p);
+    out_dists[i] = precision == PRECISION_F32
+      ? calc_harvestine_f32(p[0], p[1], p[2], p[3], EARTH_RAD)
+      : calc_harvestine(p[0], p[1], p[2], p[3], EARTH_RAD);
+  }
+}
+
+// Compares `dists` against `.dists` file written by gen_harvestine, one
+// distance per line. Prints max and mean absolute error.
+// NOTE: reference has 6 decimals, errors below 5e-7 km are its rounding.
+// Returns 0 if reference can't be read or doesn't match pair count.
+static b32 validate_dists(const char *filepath, const f64 *dists,
+    u64 pair_count) {
+  PROFILE_FUNC(pair_count * sizeof(f64));
+
+  struct buf_u8 buf = alloc_buf_file(filepath, INPUT_MODE_FREAD);
+  if (!buf.data) {
+    fprintf(stderr, "Error: failed to read '%s'.\n", filepath);
+    return false;
+  }
+
+  b32 ret = false;
+  f64 max_err = 0.0;
+  u64 max_err_index = 0;
+  f64 sum_err = 0.0;
+
+  // Buffer is zero padded, parse_f64() and '\n' check stop there
+  u64 count = 0;
+  for (u8 *p = buf.data; p < buf.end; ++count) {
+    f64 ref;
+    u8 *end = parse_f64(p, &ref);
+    if (end == p || *end != '\n') {
+      fprintf(stderr, "Error: '%s': invalid distance at line %llu\n",
+          filepath, count + 1);
+      goto cleanup;
+    }
+    if (count < pair_count) {
+      f64 err = fabs(dists[count] - ref);
+      sum_err += err;
+      if (err > max_err) {
+        max_err = err;
+        max_err_index = count;
+      }
+    }
+    p = end + 1;
+  }
+
+  if (count != pair_count) {
+    fprintf(stderr, "Error: '%s': %llu distances, expected %llu\n",
+        filepath, count, pair_count);
+    goto cleanup;
+  }
+
+  printf("Validated %llu distances against '%s'\n"
+      "  max abs error:  %.9f km (pair %llu)\n"
+      "  mean abs error: %.9f km\n",
+      pair_count, filepath,
+      max_err, max_err_index,
+      pair_count ? sum_err / pair_count : 0.0);
+  ret = true;
+
+cleanup:
+  free_buf_file(buf, INPUT_MODE_FREAD);
+  return ret;
+}
+
+static b32 validate(const char *filepath,
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count) {
+  f64 *dists = malloc(MAX(pair_count, 1LLU) * sizeof(f64));
+  if (!dists) {
+    fprintf(stderr, "Error: failed to allocate memory for distances\n");
+    return false;
+  }
+
+  calc_harvestine_dists(kernel, precision, data, column_stride, pair_count,
+      dists);
+  b32 ret = validate_dists(filepath, dists, pair_count);
+  free(dists);
+  return ret;
+}
+
+// --------------------------------------
+// Parallel average
+// --------------------------------------
+
+// Pairs are split into fixed DIST_BLOCK_PAIR_COUNT blocks. Every block gets
+// its own compensated (Neumaier) sum, then block sums are combined by
+// a pairwise tree over block indices. Neither depends on the thread count,
+// threads only decide who fills which block sums, so the average is bit
+// identical for any number of threads.
+// Blocks are multiple of SIMD kernel lanes, so kernel distances are the same
+// as for the whole array (see calc_harvestine_simd.h).
+enum {
+  DIST_THREAD_COUNT_MAX = 64,
+  DIST_BLOCK_PAIR_COUNT = 1024,   // 8 KB of distances on the stack
+};
+
+static_assert(DIST_BLOCK_PAIR_COUNT % (2 * HARVESTINE_SIMD_LANE_COUNT) == 0,
+    "Blocks should be split in the same lanes as the whole array");
+
+// Neumaier compensated sum, value is `sum + c`
+struct neumaier_sum {
+  f64 sum;
+  f64 c;
+};
+
+static FORCE_INLINE void neumaier_add(struct neumaier_sum *s, f64 v) {
+  f64 t = s->sum + v;
+  if (fabs(s->sum) >= fabs(v)) {
+    s->c += (s->sum - t) + v;
+  } else {
+    s->c += (v - t) + s->sum;
+  }
+  s->sum = t;
+}
+
+static FORCE_INLINE void neumaier_combine(struct neumaier_sum *s,
+    struct neumaier_sum other) {
+  neumaier_add(s, other.sum);
+  s->c += other.c;
+}
+
+struct dist_worker {
+  const struct harvestine_kernel *kernel;
+  enum precision precision;
+  const f64 *data;
+  u64 column_stride;
+  u64 pair_count;
+  u64 block_begin;
+  u64 block_end;
+  struct neumaier_sum *block_sums;
+};
+
+static void dist_worker_blocks(struct dist_worker *dw) {
+  PROFILE_FUNC((MIN(dw->block_end * DIST_BLOCK_PAIR_COUNT, dw->pair_count)
+        - dw->block_begin * DIST_BLOCK_PAIR_COUNT) * 4 * sizeof(f64));
+
+  f64 dists[DIST_BLOCK_PAIR_COUNT];
+  for (u64 b = dw->block_begin; b < dw->block_end; ++b) {
+    u64 first = b * DIST_BLOCK_PAIR_COUNT;
+    u64 count = MIN(dw->pair_count - first, (u64)DIST_BLOCK_PAIR_COUNT);
+    const f64 *data = dw->data + (dw->column_stride ? first : first * 4);
+    calc_harvestine_dists(dw->kernel, dw->precision, data,
+        dw->column_stride, count, dists);
+
+    struct neumaier_sum s = {0};
+    for (u64 i = 0; i < count; ++i) {
+      neumaier_add(&s, dists[i]);
+    }
+    dw->block_sums[b] = s;
+  }
+}
+
+static void *dist_worker_run(void *arg) {
+  PROFILER_THREAD_BEGIN("dist_worker");
+  dist_worker_blocks(arg);
+  PROFILER_THREAD_END();
+  return 0;
+}
+
+// Average calculated on `thread_count` threads, `kernel` 0 is libm.
+// Result doesn't depend on `thread_count`, but it might differ in the last
+// digits from avg_harvestine_distances_layout().
+static b32 avg_harvestine_distances_mt(
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count, u32 thread_count,
+    f64 *out_avg) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  *out_avg = 0.0;
+  if (!pair_count) {
+    return true;
+  }
+
+  u64 block_count =
+    (pair_count + DIST_BLOCK_PAIR_COUNT - 1) / DIST_BLOCK_PAIR_COUNT;
+  struct neumaier_sum *block_sums = malloc(block_count * sizeof(*block_sums));
+  if (!block_sums) {
+    fprintf(stderr, "Error: failed to allocate memory for block sums\n");
+    return false;
+  }
+
+  b32 ret = false;
+  struct dist_worker workers[DIST_THREAD_COUNT_MAX] = {0};
+  struct os_thread threads[DIST_THREAD_COUNT_MAX] = {0};
+  u32 started_count = 0;
+
+  thread_count = MIN(thread_count, block_count);
+  for (; started_count < thread_count; ++started_count) {
+    u32 i = started_count;
+    workers[i] = (struct dist_worker){
+      .kernel         = kernel,
+      .precision      = precision,
+      .data           = data,
+      .column_stride  = column_stride,
+      .pair_count     = pair_count,
+      .block_begin    = block_count * i / thread_count,
+      .block_end      = block_count * (i + 1) / thread_count,
+      .block_sums     = block_sums,
+    };
+    if (!os_thread_start(threads + i, dist_worker_run, workers + i)) {
+      perror("Error: os_thread_start() failed");
+      goto dist_cleanup;
+    }
+  }
+
+  PROFILE_ZONE_BEGIN_V("dist_workers_join", 0, join_zone);
+  for (u32 i = 0; i < started_count; ++i) {
+    os_thread_join(threads[i]);
+  }
+  started_count = 0;
+  PROFILE_ZONE_END_V(join_zone);
+
+  // Fixed order pairwise tree: (0 1) (2 3) ..., then (0 2) (4 6) ...
+  for (u64 step = 1; step < block_count; step *= 2) {
+    for (u64 i = 0; i + step < block_count; i += 2 * step) {
+      neumaier_combine(block_sums + i, block_sums[i + step]);
+    }
+  }
+
+  *out_avg = (block_sums[0].sum + block_sums[0].c) / pair_count;
+  ret = true;
+
+dist_cleanup:
+  for (u32 i = 0; i < started_count; ++i) {
+    os_thread_join(threads[i]);
+  }
+  free(block_sums);
+  return ret;
+}
+
+// --------------------------------------
+// Distances output
+// --------------------------------------
+
+// Distances are formatted with format_f64() into a large buffer, that is
+// written with a single syscall when full.
+enum {DISTS_WRITE_BUF_SIZE = 1024 * 1024};
+
+static b32 dists_flush(struct os_file file, const u8 *data, u64 size) {
+  PROFILE_FUNC(size);
+
+  if (!os_file_write(file, data, size)) {
+    perror("Error: write() failed");
+    return false;
+  }
+  return true;
+}
+
+// Write distance of every pair to `filepath`, one shortest round trip
+// decimal per line. The same numbers that are averaged by
+// avg_harvestine_distances_layout().
+// Returns 0 on failure.
+static b32 write_dists(const char *filepath,
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  b32 ret = false;
+  struct os_file file;
+  u8 *buf = malloc(DISTS_WRITE_BUF_SIZE);
+  if (!buf) {
+    fprintf(stderr, "Error: failed to allocate memory for distances\n");
+    return false;
+  }
+  if (!os_file_create(&file, filepath)) {
+    fprintf(stderr, "Error: failed to open file '%s'", filepath);
+    perror("");
+    free(buf);
+    return false;
+  }
+
+  u64 size = 0;
+  f64 dists[DIST_BLOCK_PAIR_COUNT];
+  for (u64 first = 0; first < pair_count; first += DIST_BLOCK_PAIR_COUNT) {
+    u64 count = MIN(pair_count - first, (u64)DIST_BLOCK_PAIR_COUNT);
+    calc_harvestine_dists(kernel, precision,
+        data + (column_stride ? first : first * 4), column_stride, count,
+        dists);
+
+    PROFILE_ZONE_BEGIN("format_dists", count * sizeof(f64));
+    for (u64 i = 0; i < count; ++i) {
+      if (size + FORMAT_F64_SIZE_MAX + 1 > DISTS_WRITE_BUF_SIZE) {
+        if (!dists_flush(file, buf, size)) {
+          goto write_dists_cleanup;
+        }
+        size = 0;
+      }
+      u8 *end = format_f64(buf + size, dists[i]);
+      *end++ = '\n';
+      size = end - buf;
+    }
+    PROFILE_ZONE_END();
+  }
+  ret = dists_flush(file, buf, size);
+
+write_dists_cleanup:
+  ret &= os_file_close(file);
+  free(buf);
+  return ret;
+}
+
+// --------------------------------------
+// Verification
+// --------------------------------------
+
+// Pass/fail check against `<basename>.avg` and `<basename>.dists` written by
+// gen_harvestine. Unlike validate() nothing is kept in memory: `.dists` is
+// memory mapped and walked front to back, distances are calculated, parsed
+// and compared block by block, so it's cheap to run over any file size.
+// NOTE: reference has 6 decimals, so the default tolerance covers its
+// rounding (5e-7 km) plus differences between libm and SIMD kernels.
+#define VERIFY_TOLERANCE_DEFAULT 1e-6 // km
+enum {VERIFY_MISMATCH_PRINT_MAX = 10};
+
+// Parse up to `count` `distance\n` lines at `*p` into `out_dists`.
+// Buffer is zero padded, parse_f64() and '\n' check stop there.
+// Returns number of parsed distances, sets `*out_error` on invalid line.
+static u64 parse_dists(u8 **p, u8 *end, f64 *out_dists, u64 count,
+    b32 *out_error) {
+  u8 *cur = *p;
+  u64 i = 0;
+  for (; i < count && cur < end; ++i) {
+    u8 *num_end = parse_f64(cur, out_dists + i);
+    if (num_end == cur || *num_end != '\n') {
+      *out_error = true;
+      break;
+    }
+    cur = num_end + 1;
+  }
+  *p = cur;
+  return i;
+}
+
+// Number of `dists` that differ from `refs` by more than `tolerance`.
+// NaN always mismatches. Branchless, so the loop is vectorized.
+static FORCE_INLINE u64 count_mismatches(const f64 *dists, const f64 *refs,
+    u64 count, f64 tolerance) {
+  u64 mismatch_count = 0;
+  for (u64 i = 0; i < count; ++i) {
+    mismatch_count += !(fabs(dists[i] - refs[i]) <= tolerance);
+  }
+  return mismatch_count;
+}
+
+static b32 verify_avg(const char *filepath, f64 avg, f64 tolerance) {
+  struct buf_u8 buf = alloc_buf_file(filepath, INPUT_MODE_FREAD);
+  if (!buf.data) {
+    fprintf(stderr, "Error: failed to read '%s'.\n", filepath);
+    return false;
+  }
+
+  f64 ref;
+  b32 parsed = parse_f64(buf.data, &ref) != buf.data;
+  free_buf_file(buf, INPUT_MODE_FREAD);
+  if (!parsed) {
+    fprintf(stderr, "Error: '%s': invalid average\n", filepath);
+    return false;
+  }
+
+  b32 ret = fabs(avg - ref) <= tolerance;
+  printf("Verified average against '%s': %s\n"
+      "  average:  %.17f\n"
+      "  expected: %.17f\n",
+      filepath, ret ? "PASS" : "FAIL", avg, ref);
+  return ret;
+}
+
+// Returns 0 on mismatch or if reference can't be read
+static b32 verify_dists(const char *filepath,
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count, f64 tolerance) {
+  PROFILE_FUNC(pair_count * 4 * sizeof(f64));
+
+  struct buf_u8 buf = alloc_buf_file(filepath, INPUT_MODE_MMAP);
+  if (!buf.data && pair_count) {
+    fprintf(stderr, "Error: failed to read '%s'.\n", filepath);
+    return false;
+  }
+
+  u8 *cur = buf.data;
+  u64 mismatch_count = 0;
+  b32 parse_error = false;
+  u64 count = 0;
+  f64 dists[DIST_BLOCK_PAIR_COUNT];
+  f64 refs[DIST_BLOCK_PAIR_COUNT];
+  while (count < pair_count) {
+    u64 block_count = MIN(pair_count - count, (u64)DIST_BLOCK_PAIR_COUNT);
+    PROFILE_ZONE_BEGIN("parse_dists", 0);
+    u64 ref_count = parse_dists(&cur, buf.end, refs, block_count,
+        &parse_error);
+    PROFILE_ZONE_END();
+    if (ref_count != block_count) {
+      count += ref_count;
+      break;
+    }
+
+    calc_harvestine_dists(kernel, precision,
+        data + (column_stride ? count : count * 4), column_stride,
+        block_count, dists);
+
+    u64 block_mismatch_count = count_mismatches(dists, refs, block_count,
+        tolerance);
+    for (u64 i = 0; block_mismatch_count && i < block_count
+        && mismatch_count < VERIFY_MISMATCH_PRINT_MAX; ++i) {
+      if (!(fabs(dists[i] - refs[i]) <= tolerance)) {
+        fprintf(stderr, "Mismatch: pair %llu: %.9f km, expected %.9f km\n",
+            count + i, dists[i], refs[i]);
+        ++mismatch_count;
+        --block_mismatch_count;
+      }
+    }
+    mismatch_count += block_mismatch_count;
+    count += block_count;
+  }
+
+  b32 ret = true;
+  if (parse_error) {
+    fprintf(stderr, "Error: '%s': invalid distance at line %llu\n",
+        filepath, count + 1);
+    ret = false;
+  } else if (count != pair_count || cur < buf.end) {
+    fprintf(stderr, "Error: '%s': distance count doesn't match %llu "
+        "pairs\n", filepath, pair_count);
+    ret = false;
+  } else {
+    ret = mismatch_count == 0;
+    printf("Verified %llu distances against '%s': %s\n"
+        "  mismatches: %llu (tolerance %g km)\n",
+        pair_count, filepath, ret ? "PASS" : "FAIL",
+        mismatch_count, tolerance);
+  }
+
+  if (buf.data) {
+    free_buf_file(buf, INPUT_MODE_MMAP);
+  }
+  return ret;
+}
+
+// Verify `avg` against `<basename>.avg` and distances of every pair against
+// `<basename>.dists`. Returns 0 if anything doesn't match.
+static b32 verify(const char *basename,
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count, f64 avg,
+    f64 tolerance) {
+  char filepath[1024];
+  snprintf(filepath, sizeof(filepath), "%s.avg", basename);
+  b32 ret = verify_avg(filepath, avg, tolerance);
+
+  snprintf(filepath, sizeof(filepath), "%s.dists", basename);
+  ret &= verify_dists(filepath, kernel, precision, data, column_stride,
+      pair_count, tolerance);
+  return ret;
+}
+
+// --------------------------------------
+// Streaming parser
+// --------------------------------------
+
+// File is read in chunks into a ring of buffers. Pair object that crosses
+// chunk boundary is carried over: copied into the carry area, that sits right
+// in front of the next chunk data, so the parser always sees contiguous
+// complete objects.
+// Peak memory is bounded by STREAM_BUF_COUNT * sizeof(struct stream_buf)
+// regardless of input size.
+enum {
+  STREAM_CHUNK_SIZE     = 4 * 1024 * 1024,
+  STREAM_CARRY_SIZE_MAX = 64 * 1024,
+  STREAM_BUF_COUNT      = 2,
+  STREAM_BATCH_SIZE     = 4 * 1024, // f64 count
+};
+
+struct stream_buf {
+  u8 data[STREAM_CARRY_SIZE_MAX + STREAM_CHUNK_SIZE];
+};
+
+enum stream_state {
+  STREAM_STATE_BEGIN,   // expecting `{"pairs": [`
+  STREAM_STATE_PAIRS,   // expecting pair objects or `]`
+  STREAM_STATE_END,     // expecting `}`
+  STREAM_STATE_DONE,
+};
+
+// Distance stage. Pairs are batched so distance calculation runs in a tight
+// loop over the data that is hot in cache. Full batch is handed to SIMD
+// kernel at once, if there is one.
+// NOTE: pair count is unknown upfront, so the average is calculated as
+// sum / count at the very end. It might differ in the last digits from
+// avg_harvestine_distances(), that multiplies every distance by 1 / count.
+struct harvestine_acc {
+  f64 batch[STREAM_BATCH_SIZE];
+  u64 batch_size;
+  u64 pair_count;
+  f64 sum;
+  const struct harvestine_kernel *kernel; // 0 - libm
+  enum precision precision;
+};
+
+static void harvestine_acc_init(struct harvestine_acc *acc,
+    const struct harvestine_kernel *kernel, enum precision precision) {
+  acc->batch_size = 0;
+  acc->pair_count = 0;
+  acc->sum = 0.0;
+  acc->kernel = kernel;
+  acc->precision = precision;
+}
+
+static void harvestine_acc_flush(struct harvestine_acc *acc) {
+  PROFILE_FUNC(acc->batch_size * sizeof(f64));
+
+  f64 sum = acc->sum;
+  u64 batch_pair_count = acc->batch_size / 4;
+  if (acc->kernel) {
+    sum += harvestine_kernel_sum(acc->kernel, acc->precision, acc->batch, 0,
+        batch_pair_count, 0);
+  } else if (acc->precision == PRECISION_F32) {
+    for (u64 i = 0; i < acc->batch_size; i += 4) {
+      sum += calc_harvestine_f32(
+          acc->batch[i + 0],
+          acc->batch[i + 1],
+          acc->batch[i + 2],
+          acc->batch[i + 3],
+          EARTH_RAD);
+    }
+  } else {
+    for (u64 i = 0; i < acc->batch_size; i += 4) {
+      sum += calc_harvestine(
+          acc->batch[i + 0],
+          acc->batch[i + 1],
+          acc->batch[i + 2],
+          acc->batch[i + 3],
+          EARTH_RAD);
+    }
+  }
+
+  acc->sum = sum;
+  acc->pair_count += batch_pair_count;
+  acc->batch_size = 0;
+}
+
+static FORCE_INLINE void harvestine_acc_push(struct harvestine_acc *acc,
+    const f64 coords[4]) {
+  memcpy(acc->batch + acc->batch_size, coords, 4 * sizeof(f64));
+  acc->batch_size += 4;
+  if (acc->batch_size == STREAM_BATCH_SIZE) {
+    harvestine_acc_flush(acc);
+  }
+}
+
+// Parse complete pair objects in [w->cur, w->buf.end) and feed them to `acc`.
+// Returns 0 on parse error.
+static b32 parse_pairs_chunk(struct walk * restrict w,
+    enum stream_state *state, struct harvestine_acc * restrict acc) {
+  PROFILE_FUNC(w->buf.end - w->buf.data);
+
+  // Chunk is cut in the middle of the buffer, keep bounds checks
+  struct parse_opts opts = {0};
+
+  skip_whitespace(w, opts);
+  if (*state == STREAM_STATE_BEGIN && w->cur < w->buf.end) {
+    if (!parse_pairs_begin(w, opts)) {
+      return 0;
+    }
+    *state = STREAM_STATE_PAIRS;
+  }
+
+  while (*state == STREAM_STATE_PAIRS) {
+    skip_whitespace(w, opts);
+    if (w->cur >= w->buf.end) {
+      break; // the rest of pairs is in the next chunk
+    }
+
+    if (accept_char(w, ']', opts)) {
+      *state = STREAM_STATE_END;
+      break;
+    }
+
+    f64 coords[4] = {0};
+    if (!parse_pair(w, coords, opts)) {
+      return 0;
+    }
+    harvestine_acc_push(acc, coords);
+  }
+
+  skip_whitespace(w, opts);
+  if (*state == STREAM_STATE_END && w->cur < w->buf.end) {
+    if (!expect_char(w, '}', opts)) {
+      return 0;
+    }
+    *state = STREAM_STATE_DONE;
+  }
+  return 1;
+}
+
+// Streaming parser state carried between chunks
+struct stream_parser {
+  struct harvestine_acc acc;
+  enum stream_state state;
+  u8 *carry;
+  u64 carry_size;
+  u64 file_offset;
+};
+
+static void stream_parser_init(struct stream_parser *p) {
+  harvestine_acc_init(&p->acc, 0, PRECISION_F64);
+  p->state = STREAM_STATE_BEGIN;
+  p->carry = 0;
+  p->carry_size = 0;
+  p->file_offset = 0;
+}
+
+// Parse chunk of `size` bytes, that has STREAM_CARRY_SIZE_MAX bytes of carry
+// area in front of it.
+// Carry is copied from the previous chunk, so the previous chunk must stay
+// intact until this call returns.
+// Returns 0 on failure.
+static b32 stream_parser_feed(struct stream_parser *p, u8 *chunk, u64 size,
+    b32 eof) {
+  u8 *begin = chunk - p->carry_size;
+  u8 *end = chunk + size;
+  u64 begin_offset = p->file_offset - p->carry_size;
+  memcpy(begin, p->carry, p->carry_size);
+
+  // Cut at the beginning of the last (possibly incomplete) pair object
+  u8 *parse_end = eof ? end : find_last_char(begin, end, '{');
+  p->carry = parse_end;
+  p->carry_size = end - parse_end;
+  if (p->carry_size > STREAM_CARRY_SIZE_MAX) {
+    fprintf(stderr, "Error: json value at position %llu is larger "
+        "than %d bytes\n", p->file_offset + (parse_end - chunk),
+        STREAM_CARRY_SIZE_MAX);
+    return 0;
+  }
+  p->file_offset += size;
+
+  struct walk w = {{begin, parse_end}, begin, {0}, {0}};
+  b32 ret = parse_pairs_chunk(&w, &p->state, &p->acc);
+  parse_stats_add(w.stats);
+  if (!ret) {
+    parse_error_print(&w.error, begin, parse_end, begin_offset);
+  }
+  return ret;
+}
+
+// Returns 0 on failure.
+static b32 stream_parser_finish(struct stream_parser *p, f64 *out_avg) {
+  if (p->state != STREAM_STATE_DONE) {
+    fprintf(stderr, "Parser error: unexpected end of file\n");
+    return 0;
+  }
+
+  harvestine_acc_flush(&p->acc);
+  *out_avg = p->acc.pair_count ? p->acc.sum / p->acc.pair_count : 0.0;
+  return 1;
+}
+
+// Parse the whole json buffer and calculate average of distances while
+// parsing. Coordinates only live in the accumulator batch, so memory usage
+// beside `json_buf` doesn't depend on pair count.
+// Returns 0 on failure.
+static b32 parse_coords_json_fused(struct buf_u8 json_buf,
+    const struct harvestine_kernel *kernel, enum precision precision,
+    f64 *out_avg) {
+  PROFILE_FUNC(json_buf.end - json_buf.data);
+
+  struct harvestine_acc acc;
+  harvestine_acc_init(&acc, kernel, precision);
+
+  struct walk w = {json_buf, json_buf.data, {0}, {0}};
+  enum stream_state state = STREAM_STATE_BEGIN;
+  b32 parsed = parse_pairs_chunk(&w, &state, &acc);
+  parse_stats_add(w.stats);
+  if (!parsed) {
+    walk_print_error(&w);
+    return 0;
+  }
+  if (state != STREAM_STATE_DONE) {
+    fprintf(stderr, "Parser error: unexpected end of file\n");
+    return 0;
+  }
+
+  harvestine_acc_flush(&acc);
+  *out_avg = acc.pair_count ? acc.sum / acc.pair_count : 0.0;
+  return 1;
+}
+
+// Read and parse json file chunk by chunk, calculate average of distances
+// without storing coordinates.
+// Returns 0 on failure.
+static b32 parse_coords_json_stream(const char *filepath, f64 *out_avg) {
+  PROFILE_FUNC(os_file_size_bytes(filepath));
+
+  b32 ret = 0;
+  struct stream_buf *bufs = 0;
+  struct stream_parser *parser = 0;
+
+  FILE *f = fopen(filepath, "rb");
+  if (!f) {
+    perror("Error: fopen() failed");
+    goto stream_cleanup;
+  }
+
+  bufs = malloc(STREAM_BUF_COUNT * sizeof(*bufs));
+  parser = malloc(sizeof(*parser));
+  if (!bufs || !parser) {
+    perror("Error: malloc failed");
+    goto stream_cleanup;
+  }
+  stream_parser_init(parser);
+
+  b32 eof = false;
+  for (u64 chunk_index = 0; !eof; ++chunk_index) {
+    struct stream_buf *buf = bufs + chunk_index % STREAM_BUF_COUNT;
+    u8 *chunk = buf->data + STREAM_CARRY_SIZE_MAX;
+
+    PROFILE_ZONE_BEGIN("fread", STREAM_CHUNK_SIZE);
+    u64 read_size = fread(chunk, 1, STREAM_CHUNK_SIZE, f);
+    PROFILE_ZONE_END();
+
+    if (read_size != STREAM_CHUNK_SIZE) {
+      if (ferror(f)) {
+        perror("Error: fread() failed");
+        goto stream_cleanup;
+      }
+      eof = true;
+    }
+
+    if (!stream_parser_feed(parser, chunk, read_size, eof)) {
+      goto stream_cleanup;
+    }
+  }
+
+  ret = stream_parser_finish(parser, out_avg);
+
+stream_cleanup:
+  free(parser);
+  free(bufs);
+  if (f) {
+    fclose(f);
+  }
+  return ret;
+}
+
+// --------------------------------------
+// Pipelined streaming parser
+// --------------------------------------
+
+// Reader thread fills a ring of chunk buffers, while the parser (main thread)
+// drains them and feeds parsed pairs to the distance stage.
+// Ring is single producer single consumer:
+// * reader publishes filled chunks by incrementing `filled_count`
+// * parser returns chunk buffers by incrementing `released_count`. A chunk is
+//   released only after the next chunk has copied carry out of it.
+// A side that has to wait blocks in os_wait() on the other side's counter,
+// so wait zones show time blocked on I/O or parsing without burning a core.
+// Counters are u32 for futex, chunk indices wrap after 16 PB.
+enum {PIPELINE_BUF_COUNT = 4};
+
+struct pipeline_chunk {
+  u64 size;
+  b32 eof;
+  b32 error;
+};
+
+struct pipeline {
+  FILE *f;
+  u64 file_size;                                // for profiler bandwidth
+  struct stream_buf *bufs;                      // PIPELINE_BUF_COUNT
+  struct pipeline_chunk chunks[PIPELINE_BUF_COUNT];
+
+  _Atomic u32 filled_count;
+  _Atomic u32 released_count;
+  _Atomic b32 cancel;                           // parser failed, stop reading
+};
+
+// Block until chunk buffer of `chunk_index` is released.
+// Returns false if parser has failed and reading was cancelled
+static b32 pipeline_reader_wait(struct pipeline *p, u32 chunk_index) {
+  PROFILE_FUNC(0);
+  for (;;) {
+    // Acquire of the counter makes `cancel` stored before it visible
+    u32 released = atomic_load_explicit(&p->released_count,
+        memory_order_acquire);
+    if (atomic_load_explicit(&p->cancel, memory_order_relaxed)) {
+      return false;
+    }
+    if (chunk_index - released < PIPELINE_BUF_COUNT) {
+      return true;
+    }
+    os_wait(&p->released_count, released);
+  }
+}
+
+// Block until chunk `chunk_index` is filled
+static void pipeline_parser_wait(struct pipeline *p, u32 chunk_index) {
+  PROFILE_FUNC(0);
+  for (;;) {
+    u32 filled = atomic_load_explicit(&p->filled_count, memory_order_acquire);
+    // filled > chunk_index, reader is at most PIPELINE_BUF_COUNT ahead
+    if (filled - chunk_index - 1 < PIPELINE_BUF_COUNT) {
+      return;
+    }
+    os_wait(&p->filled_count, filled);
+  }
+}
+
+static void pipeline_reader_fread(struct pipeline *p, u64 chunk_index) {
+  PROFILE_FUNC(MIN((u64)STREAM_CHUNK_SIZE,
+        p->file_size - MIN(chunk_index * STREAM_CHUNK_SIZE, p->file_size)));
+  struct pipeline_chunk *chunk = p->chunks + chunk_index % PIPELINE_BUF_COUNT;
+  u8 *data = p->bufs[chunk_index % PIPELINE_BUF_COUNT].data
+    + STREAM_CARRY_SIZE_MAX;
+  chunk->size = fread(data, 1, STREAM_CHUNK_SIZE, p->f);
+  chunk->eof = chunk->size != STREAM_CHUNK_SIZE;
+  chunk->error = ferror(p->f);
+}
+
+static void *pipeline_reader(void *arg) {
+  struct pipeline *p = arg;
+  PROFILER_THREAD_BEGIN("pipeline_reader");
+
+  for (u32 i = 0; pipeline_reader_wait(p, i); ++i) {
+    pipeline_reader_fread(p, i);
+
+    atomic_store_explicit(&p->filled_count, i + 1, memory_order_release);
+    os_wake_all(&p->filled_count);
+    if (p->chunks[i % PIPELINE_BUF_COUNT].eof) {
+      break;
+    }
+  }
+
+  PROFILER_THREAD_END();
+  return 0;
+}
+
+// Same as parse_coords_json_stream(), but file reading on a background
+// thread overlaps with parsing and distance calculation.
+// Returns 0 on failure.
+static b32 parse_coords_json_pipeline(const char *filepath, f64 *out_avg) {
+  u64 file_size = os_file_size_bytes(filepath);
+  PROFILE_FUNC(file_size);
+
+  b32 ret = 0;
+  struct pipeline *p = 0;
+  struct stream_parser *parser = 0;
+  b32 reader_started = false;
+  struct os_thread reader = {0};
+
+  FILE *f = fopen(filepath, "rb");
+  if (!f) {
+    perror("Error: fopen() failed");
+    goto pipeline_cleanup;
+  }
+
+  p = calloc(1, sizeof(*p));
+  parser = malloc(sizeof(*parser));
+  if (!p || !parser) {
+    perror("Error: malloc failed");
+    goto pipeline_cleanup;
+  }
+
+  p->bufs = malloc(PIPELINE_BUF_COUNT * sizeof(*p->bufs));
+  if (!p->bufs) {
+    perror("Error: malloc failed");
+    goto pipeline_cleanup;
+  }
+  p->f = f;
+  p->file_size = file_size;
+  stream_parser_init(parser);
+
+  reader_started = os_thread_start(&reader, pipeline_reader, p);
+  if (!reader_started) {
+    perror("Error: os_thread_start() failed");
+    goto pipeline_cleanup;
+  }
+
+  b32 eof = false;
+  for (u32 i = 0; !eof; ++i) {
+    pipeline_parser_wait(p, i);
+
+    struct pipeline_chunk *chunk = p->chunks + i % PIPELINE_BUF_COUNT;
+    u8 *data = p->bufs[i % PIPELINE_BUF_COUNT].data + STREAM_CARRY_SIZE_MAX;
+    if (chunk->error) {
+      fprintf(stderr, "Error: fread() failed\n");
+      goto pipeline_cleanup;
+    }
+    eof = chunk->eof;
+
+    if (!stream_parser_feed(parser, data, chunk->size, eof)) {
+      goto pipeline_cleanup;
+    }
+
+    // Carry has been copied out of the previous chunk buffer
+    atomic_store_explicit(&p->released_count, i, memory_order_release);
+    os_wake_all(&p->released_count);
+  }
+
+  ret = stream_parser_finish(parser, out_avg);
+
+pipeline_cleanup:
+  if (reader_started) {
+    // Changed counter wakes reader even if it is just about to os_wait()
+    atomic_store_explicit(&p->cancel, true, memory_order_relaxed);
+    atomic_fetch_add_explicit(&p->released_count, 1, memory_order_release);
+    os_wake_all(&p->released_count);
+    os_thread_join(reader);
+  }
+  if (p) {
+    free(p->bufs);
+  }
+  free(p);
+  free(parser);
+  if (f) {
+    fclose(f);
+  }
+  return ret;
+}
+
+// --------------------------------------
+// Parser strategies
+// --------------------------------------
+
+typedef b32 parse_coords_json_func_t(struct buf_u8 json_buf,
+    struct coords *out_coords);
+
+struct parser {
+  const char *name;
+  parse_coords_json_func_t *func;
+};
+
+// The first one is the default and the reference for --bench
+static const struct parser s_parsers[] = {
+  {"baseline",    parse_coords_json},
+  {"sentinel",    parse_coords_json_sentinel},
+  {"branchless",  parse_coords_json_branchless},
+  {"lut",         parse_coords_json_lut},
+};
+
+// Slower than baseline, not selectable with --parser, only run by --bench
+static const struct parser s_experimental_parsers[] = {
+  {"simd",        parse_coords_json_simd},
+};
+
+enum {
+  BENCH_PARSER_COUNT =
+    ARRAY_COUNT(s_parsers) + ARRAY_COUNT(s_experimental_parsers),
+};
+
+static const struct parser *bench_parser(u32 i) {
+  return i < ARRAY_COUNT(s_parsers)
+    ? s_parsers + i
+    : s_experimental_parsers + i - ARRAY_COUNT(s_parsers);
+}
+
+enum {
+  BENCH_TRY_DURATION_SEC  = 3,
+  TRACE_EVENT_COUNT       = 1 << 20,  // per thread, 16 MB
+};
+
+// Run every parser under repetition tester on the same `json_buf`, check
+// that it produces the same coordinates as the first one and print
+// comparison table.
+// Returns 0 on failure.
+static b32 bench_parsers(struct buf_u8 json_buf, struct coords *coords) {
+  b32 ret = 0;
+  u64 cpu_timer_freq = get_or_estimate_cpu_timer_freq(300);
+  u64 json_size = json_buf.end - json_buf.data;
+  struct tester testers[BENCH_PARSER_COUNT] = {0};
+
+  f64 *reference = 0;
+  u64 reference_size = 0;
+
+  for (u32 i = 0; i < BENCH_PARSER_COUNT; ++i) {
+    const struct parser *parser = bench_parser(i);
+    struct tester *tester = testers + i;
+    tester->try_duration_tsc = BENCH_TRY_DURATION_SEC * cpu_timer_freq;
+    tester->expected_bytes   = json_size;
+
+    fprintf(stderr, "--- Parser %s ---\n", parser->name);
+    while (tester_step(tester)) {
+      tester_zone_begin(tester);
+      b32 parsed = parser->func(json_buf, coords);
+      tester_zone_end(tester);
+
+      tester_count_bytes(tester, json_size);
+
+      if (!parsed) {
+        tester_error(tester, "failed to parse json");
+      } else if (reference && (coords->size != reference_size
+            || memcmp(coords->data, reference, reference_size * sizeof(f64)))) {
+        tester_error(tester, "coordinates differ from the first parser");
+      }
+    }
+    tester_print(tester, cpu_timer_freq);
+
+    if (tester->run.state == TESTER_STATE_ERROR) {
+      goto bench_cleanup;
+    }
+
+    if (!reference) {
+      reference_size = coords->size;
+      reference = malloc(reference_size * sizeof(f64));
+      if (!reference) {
+        perror("Error: malloc failed");
+        goto bench_cleanup;
+      }
+      memcpy(reference, coords->data, reference_size * sizeof(f64));
+    }
+  }
+
+  fprintf(stderr, "%-12s|%10s|%10s|%10s|%8s\n",
+      "Parser", "Min ms", "Avg ms", "GB/s", "Speedup");
+  fprintf(stderr, "------------------------------------------------------\n");
+  f64 reference_tsc = 0.0;
+  for (u32 i = 0; i < BENCH_PARSER_COUNT; ++i) {
+    struct tester_stats *stats = &testers[i].stats;
+    f64 min_tsc = (f64)(stats->min_plus_one.e[TESTER_VALUE_TSC] - 1);
+    f64 avg_tsc = (f64)stats->total.e[TESTER_VALUE_TSC]
+      / stats->total.e[TESTER_VALUE_STEP_COUNT];
+    f64 min_sec = min_tsc / cpu_timer_freq;
+    if (i == 0) {
+      reference_tsc = min_tsc;
+    }
+    fprintf(stderr, "%-12s|%10.3f|%10.3f|%10.3f|%7.2fx\n",
+        bench_parser(i)->name, min_sec * 1e3, avg_tsc / cpu_timer_freq * 1e3,
+        json_size / (min_sec * 1024 * 1024 * 1024), reference_tsc / min_tsc);
+  }
+  ret = 1;
+
+bench_cleanup:
+  free(reference);
+  return ret;
+}
+
+// --------------------------------------
+// Main
 // --------------------------------------
-// Main
-// --------------------------------------
+
 static void print_usage(void) {
-  fprintf(stderr, "Usage:\n    harvestine <in_filename> <out_filename>\n");
+  fprintf(stderr,
+      "Calculate average of harvestine distances of coordinate pairs\n"
+      "from input json.\n"
+      "\n"
+      "Usage:\n"
+      "    harvestine [OPTIONS] <in_filename> <out_filename>\n"
+      "\n"
+      "OPTIONS\n"
+      "    -h                - this help.\n"
+      "    --input=<mode>    - how input file is loaded into memory:\n"
+      "                        fread - read into malloc'ed buffer (default)\n"
+      "                        mmap  - memory map and parse directly from\n"
+      "                                the map\n"
+      "                        stream - read in %d MB chunks and calculate\n"
+      "                                 distances while parsing, memory\n"
+      "                                 usage doesn't depend on file size\n"
+      "                        pipeline - same as stream, but chunks are\n"
+      "                                   read on a background thread\n"
+      "                        bin - memory map binary coordinates file\n"
+      "                              (see --emit-bin, gen_harvestine --bin)\n"
+      "    --parser=<name>   - json parser, supported with fread and mmap\n"
+      "                        input modes:\n"
+      "                        baseline - predictive parser (default)\n"
+      "                        sentinel - predictive parser without bounds\n"
+      "                                   checks, relies on zero padding\n"
+      "                                   after file content\n"
+      "                        branchless - predictive parser with\n"
+      "                                     branchless whitespace checks\n"
+      "                        lut      - predictive parser with char\n"
+      "                                   class lookup table\n"
+      "    --bench           - run every parser under repetition tester\n"
+      "                        for %d seconds, print comparison table and\n"
+      "                        profiler stats, output file is not written.\n"
+      "                        Also runs experimental simd parser (index of\n"
+      "                        structural characters). Supported with fread\n"
+      "                        and mmap input modes\n"
+      "    --threads=<N>     - parse pairs on N threads with baseline\n"
+      "                        parser, N <= %d.\n"
+      "                        Supported with fread and mmap input modes\n",
+      STREAM_CHUNK_SIZE / 1024 / 1024,
+      BENCH_TRY_DURATION_SEC,
+      PARSE_THREAD_COUNT_MAX);
+  fprintf(stderr,
+      "    --emit-bin=<file> - write parsed coordinates to binary file,\n"
+      "                        supported with fread and mmap input modes\n"
+      "    --huge-pages      - back parsed coordinates with huge pages\n"
+      "    --soa             - store parsed coordinates in x0[] y0[] x1[]\n"
+      "                        y1[] columns instead of x0 y0 x1 y1 records\n"
+      "    --kernel=<name>   - harvestine distance kernel, supported with\n"
+      "                        fread, mmap and bin input modes:\n"
+      "                        libm - calc_harvestine() (default)\n"
+      "                        auto - widest SIMD kernel supported by CPU\n"
+      "                        %s - polynomial sin, cos, asin\n"
+      "    --precision=<p>   - distance calculation precision, supported\n"
+      "                        with fread, mmap and bin input modes:\n"
+      "                        f64 - default\n"
+      "                        f32 - coordinates and math in f32. Mean\n"
+      "                              error is about 1 m on gen_harvestine\n"
+      "                              data, near antipodes it can be a few\n"
+      "                              km, 1 m accuracy is not met there\n"
+      "    --validate=<file> - compare every distance with .dists file\n"
+      "                        written by gen_harvestine, print max and\n"
+      "                        mean absolute error. Supported with fread,\n"
+      "                        mmap and bin input modes\n"
+      "    --dists=<file>    - write distance of every pair to file, one\n"
+      "                        shortest round trip decimal per line.\n"
+      "                        Supported with fread, mmap and bin input\n"
+      "                        modes\n"
+      "    --verify=<base>   - check average and distance of every pair\n"
+      "                        against <base>.avg and <base>.dists written\n"
+      "                        by gen_harvestine, print first mismatches\n"
+      "                        and exit with 1 if any. Supported with\n"
+      "                        fread, mmap and bin input modes\n"
+      "    --tolerance=<km>  - --verify max absolute error, default %g\n"
+      "    --fused           - calculate distances while parsing without\n"
+      "                        storing coordinates, memory usage doesn't\n"
+      "                        depend on pair count. Supported with fread\n"
+      "                        and mmap input modes, baseline parser,\n"
+      "                        --kernel and --precision\n"
+      "    --avg-threads=<N> - calculate distances on N threads,\n"
+      "                        N <= %d. Average is the same for any N.\n"
+      "                        Supported with fread, mmap and bin input\n"
+      "                        modes\n"
+      "    --profile-threads - also print profiler zones of every thread\n"
+      "    --trace=<file>    - write every profiler zone as Chrome trace\n"
+      "                        json, last %d events per thread\n"
+      "    --pmc[=<list>]    - record hardware counters in profiler zones,\n"
+      "                        comma separated list of: cycles,\n"
+      "                        instructions, l1d_misses, llc_misses,\n"
+      "                        branch_misses, stalled_cycles. Default all\n"
+      "    --profile-csv     - print profiler stats as csv\n"
+      "    --profile-tree    - print profiler call tree instead of flat\n"
+      "                        zone stats\n"
+      "    --folded=<file>   - write profiler call tree as folded stacks\n"
+      "                        for flamegraph.pl\n"
+      "    --profile=<lvls>  - profiler levels: comma separated list of\n"
+      "                        0 (high level), 1 (parser), 2 (all\n"
+      "                        functions) or 'off'. Default 0,1, also\n"
+      "                        read from HARVESTINE_PROFILE env variable\n",
+      harvestine_kernel_names(),
+      VERIFY_TOLERANCE_DEFAULT,
+      DIST_THREAD_COUNT_MAX,
+      TRACE_EVENT_COUNT
+      );
+}
+
+// Returns 0 on failure
+static const struct parser *parser_from_cstr(const char *s) {
+  for (u32 i = 0; i < ARRAY_COUNT(s_parsers); ++i) {
+    if (strcmp(s, s_parsers[i].name) == 0) {
+      return s_parsers + i;
+    }
+  }
+  return 0;
+}
+
+// Comma separated os_pmc_name() list to `1 << enum os_pmc` mask.
+// Returns 0 on failure
+static u32 pmc_mask_from_cstr(const char *s) {
+  u32 mask = 0;
+  while (*s) {
+    const char *end = strchr(s, ',');
+    u64 size = end ? (u64)(end - s) : strlen(s);
+
+    u32 kind = 0;
+    for (; kind < OS_PMC_COUNT; ++kind) {
+      const char *name = os_pmc_name(kind);
+      if (strlen(name) == size && strncmp(s, name, size) == 0) {
+        break;
+      }
+    }
+    if (kind == OS_PMC_COUNT) {
+      return 0;
+    }
+
+    mask |= 1 << kind;
+    s += size + (end != 0);
+  }
+  return mask;
+}
+
+// "off" or comma separated list of levels 0-2 to `1 << level` mask.
+// Returns false on failure
+static b32 profile_levels_from_cstr(const char *s, u32 *out_level_mask) {
+  if (strcmp(s, "off") == 0) {
+    *out_level_mask = 0;
+    return true;
+  }
+
+  u32 mask = 0;
+  do {
+    if (*s < '0' || *s > '2' || (s[1] && (s[1] != ',' || !s[2]))) {
+      return false;
+    }
+    mask |= 1 << (*s - '0');
+    s += s[1] ? 2 : 1;
+  } while (*s);
+
+  *out_level_mask = mask;
+  return true;
+}
+
+// Returns PRECISION_COUNT on failure
+static enum precision precision_from_cstr(const char *s) {
+  for (u32 i = 0; i < PRECISION_COUNT; ++i) {
+    if (strcmp(s, s_precision_names[i]) == 0) {
+      return i;
+    }
+  }
+  return PRECISION_COUNT;
+}
+
+// Serial or parallel average, `avg_thread_count` 0 is serial
+static b32 avg_harvestine_distances_main(
+    const struct harvestine_kernel *kernel, enum precision precision,
+    const f64 *data, u64 column_stride, u64 pair_count,
+    u32 avg_thread_count, f64 *out_avg) {
+  if (avg_thread_count) {
+    return avg_harvestine_distances_mt(kernel, precision, data,
+        column_stride, pair_count, avg_thread_count, out_avg);
+  }
+  *out_avg = avg_harvestine_distances_layout(kernel, precision, data,
+      column_stride, pair_count);
+  return true;
+}
+
+// Returns INPUT_MODE_COUNT on failure
+static enum input_mode input_mode_from_cstr(const char *s) {
+  for (u32 i = 0; i < INPUT_MODE_COUNT; ++i) {
+    if (strcmp(s, s_input_mode_names[i]) == 0) {
+      return i;
+    }
+  }
+  return INPUT_MODE_COUNT;
 }
 
 int main(int argc, char **argv) {
@@ -457,30 +2893,339 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  const char *in_filename = argv[1];
-  const char *out_filename = argv[2];
+  // options
+  enum input_mode input_mode = INPUT_MODE_FREAD;
+  u32 thread_count = 1;
+  u32 avg_thread_count = 0; // 0 - single threaded avg on the main thread
+  const struct parser *parser = s_parsers;
+  const char *emit_bin_filename = 0;
+  b32 huge_pages = false;
+  enum coords_bin_layout coords_layout = COORDS_BIN_LAYOUT_AOS;
+  const struct harvestine_kernel *kernel = 0; // libm
+  enum precision precision = PRECISION_F64;
+  const char *validate_filename = 0;
+  b32 fused = false;
+  const char *dists_filename = 0;
+  const char *verify_basename = 0;
+  f64 tolerance = VERIFY_TOLERANCE_DEFAULT;
+  b32 bench = false;
+  b32 profile_threads = false;
+  const char *trace_filename = 0;
+  u32 pmc_mask = 0;
+  b32 profile_csv = false;
+  u32 profile_levels = PROFILER_LEVEL_MASK_DEFAULT;
+  b32 profile_tree = false;
+  const char *folded_filename = 0;
+
+  const char *profile_env = getenv("HARVESTINE_PROFILE");
+  if (profile_env && !profile_levels_from_cstr(profile_env, &profile_levels)) {
+    fprintf(stderr, "Error: invalid HARVESTINE_PROFILE '%s'\n", profile_env);
+    print_usage();
+    return 1;
+  }
+
+  int filename_argc = argc - 2;
+  for (int cur_argc = 1; cur_argc < filename_argc; ++cur_argc) {
+    const char *arg = argv[cur_argc];
+    if (strncmp(arg, "--input=", 8) == 0) {
+      input_mode = input_mode_from_cstr(arg + 8);
+      if (input_mode == INPUT_MODE_COUNT) {
+        fprintf(stderr, "Error: unknown input mode '%s'\n", arg + 8);
+        print_usage();
+        return 1;
+      }
+    } else if (strncmp(arg, "--parser=", 9) == 0) {
+      parser = parser_from_cstr(arg + 9);
+      if (!parser) {
+        fprintf(stderr, "Error: unknown parser '%s'\n", arg + 9);
+        print_usage();
+        return 1;
+      }
+    } else if (strncmp(arg, "--threads=", 10) == 0) {
+      thread_count = atol(arg + 10);
+      if (thread_count < 1 || thread_count > PARSE_THREAD_COUNT_MAX) {
+        fprintf(stderr, "Error: invalid thread count '%s'\n", arg + 10);
+        print_usage();
+        return 1;
+      }
+    } else if (strncmp(arg, "--avg-threads=", 14) == 0) {
+      avg_thread_count = atol(arg + 14);
+      if (avg_thread_count < 1
+          || avg_thread_count > DIST_THREAD_COUNT_MAX) {
+        fprintf(stderr, "Error: invalid thread count '%s'\n", arg + 14);
+        print_usage();
+        return 1;
+      }
+    } else if (strncmp(arg, "--emit-bin=", 11) == 0 && arg[11]) {
+      emit_bin_filename = arg + 11;
+    } else if (strcmp(arg, "--huge-pages") == 0) {
+      huge_pages = true;
+    } else if (strncmp(arg, "--dists=", 8) == 0 && arg[8]) {
+      dists_filename = arg + 8;
+    } else if (strncmp(arg, "--verify=", 9) == 0 && arg[9]) {
+      verify_basename = arg + 9;
+    } else if (strncmp(arg, "--tolerance=", 12) == 0) {
+      u8 *end = parse_f64((u8 *)arg + 12, &tolerance);
+      if (end == (u8 *)arg + 12 || *end || !(tolerance >= 0.0)) {
+        fprintf(stderr, "Error: invalid tolerance '%s'\n", arg + 12);
+        print_usage();
+        return 1;
+      }
+    } else if (strcmp(arg, "--fused") == 0) {
+      fused = true;
+    } else if (strcmp(arg, "--bench") == 0) {
+      bench = true;
+    } else if (strcmp(arg, "--profile-threads") == 0) {
+      profile_threads = true;
+    } else if (strncmp(arg, "--trace=", 8) == 0 && arg[8]) {
+      trace_filename = arg + 8;
+    } else if (strcmp(arg, "--pmc") == 0) {
+      pmc_mask = (1 << OS_PMC_COUNT) - 1;
+    } else if (strncmp(arg, "--pmc=", 6) == 0) {
+      pmc_mask = pmc_mask_from_cstr(arg + 6);
+      if (!pmc_mask) {
+        fprintf(stderr, "Error: unknown hardware counters '%s'\n", arg + 6);
+        print_usage();
+        return 1;
+      }
+    } else if (strcmp(arg, "--profile-csv") == 0) {
+      profile_csv = true;
+    } else if (strcmp(arg, "--profile-tree") == 0) {
+      profile_tree = true;
+    } else if (strncmp(arg, "--folded=", 9) == 0 && arg[9]) {
+      folded_filename = arg + 9;
+    } else if (strncmp(arg, "--profile=", 10) == 0) {
+      if (!profile_levels_from_cstr(arg + 10, &profile_levels)) {
+        fprintf(stderr, "Error: invalid profiler levels '%s'\n", arg + 10);
+        print_usage();
+        return 1;
+      }
+    } else if (strcmp(arg, "--soa") == 0) {
+      coords_layout = COORDS_BIN_LAYOUT_SOA;
+    } else if (strncmp(arg, "--precision=", 12) == 0) {
+      precision = precision_from_cstr(arg + 12);
+      if (precision == PRECISION_COUNT) {
+        fprintf(stderr, "Error: unknown precision '%s'\n", arg + 12);
+        print_usage();
+        return 1;
+      }
+    } else if (strncmp(arg, "--validate=", 11) == 0 && arg[11]) {
+      validate_filename = arg + 11;
+    } else if (strncmp(arg, "--kernel=", 9) == 0) {
+      if (strcmp(arg + 9, "libm") != 0) {
+        kernel = harvestine_kernel_find(arg + 9);
+        if (!kernel) {
+          fprintf(stderr, "Error: unknown or not supported by CPU kernel "
+              "'%s'\n", arg + 9);
+          print_usage();
+          return 1;
+        }
+      }
+    } else {
+      fprintf(stderr, "Error: unrecognized option '%s'\n", arg);
+      print_usage();
+      return 1;
+    }
+  }
 
-  PROFILER_BEGIN();
+  if (thread_count > 1
+      && input_mode != INPUT_MODE_FREAD && input_mode != INPUT_MODE_MMAP) {
+    fprintf(stderr, "Error: --threads requires fread or mmap input mode\n");
+    return 1;
+  }
+  if (parser != s_parsers
+      && ((input_mode != INPUT_MODE_FREAD && input_mode != INPUT_MODE_MMAP)
+        || thread_count > 1)) {
+    fprintf(stderr, "Error: --parser requires fread or mmap input mode and "
+        "a single thread\n");
+    return 1;
+  }
 
-  struct buf_u8 json_buf = alloc_buf_file_read(in_filename);
-  if (!json_buf.data) {
-    fprintf(stderr, "Error: failed to read '%s'.\n", in_filename);
+  if (emit_bin_filename
+      && input_mode != INPUT_MODE_FREAD && input_mode != INPUT_MODE_MMAP) {
+    fprintf(stderr, "Error: --emit-bin requires fread or mmap input mode\n");
+    return 1;
+  }
+  if ((kernel || precision != PRECISION_F64 || validate_filename
+        || avg_thread_count || dists_filename || verify_basename)
+      && (input_mode == INPUT_MODE_STREAM
+        || input_mode == INPUT_MODE_PIPELINE)) {
+    fprintf(stderr, "Error: --kernel, --precision, --validate, "
+        "--avg-threads, --dists and --verify require fread, mmap or bin "
+        "input mode\n");
     return 1;
   }
 
-  b32 parsed = parse_coords_json(json_buf, &s_coords);
-  free(json_buf.data);
+  if (fused
+      && ((input_mode != INPUT_MODE_FREAD && input_mode != INPUT_MODE_MMAP)
+        || thread_count > 1 || parser != s_parsers || emit_bin_filename
+        || coords_layout != COORDS_BIN_LAYOUT_AOS || huge_pages
+        || validate_filename || avg_thread_count || dists_filename
+        || verify_basename)) {
+    fprintf(stderr, "Error: --fused requires fread or mmap input mode, "
+        "baseline parser and doesn't store coordinates\n");
+    return 1;
+  }
 
-  if (!parsed) {
-    fprintf(stderr, "Error: failed to parse json file '%s'.\n", in_filename);
+  if (bench
+      && ((input_mode != INPUT_MODE_FREAD && input_mode != INPUT_MODE_MMAP)
+        || thread_count > 1 || parser != s_parsers || fused
+        || emit_bin_filename || coords_layout != COORDS_BIN_LAYOUT_AOS
+        || validate_filename || dists_filename || verify_basename)) {
+    fprintf(stderr, "Error: --bench requires fread or mmap input mode and "
+        "runs every parser itself\n");
     return 1;
   }
 
-  f64 avg = avg_harvestine_distances(&s_coords);
+  const char *in_filename = argv[filename_argc];
+  const char *out_filename = argv[filename_argc + 1];
+
+  PROFILER_ENABLE(profile_levels);
+  if (trace_filename) {
+    PROFILER_TRACE_BEGIN(TRACE_EVENT_COUNT);
+  }
+  if (pmc_mask) {
+    PROFILER_PMC_BEGIN(pmc_mask);
+  }
+  PROFILER_BEGIN();
+
+  f64 avg = 0.0;
+  if (bench) {
+    if (!coords_init(&s_coords, coords_layout, huge_pages)) {
+      return 1;
+    }
+
+    struct buf_u8 json_buf = alloc_buf_file(in_filename, input_mode);
+    if (!json_buf.data) {
+      fprintf(stderr, "Error: failed to read '%s'.\n", in_filename);
+      return 1;
+    }
+
+    b32 benched = bench_parsers(json_buf, &s_coords);
+    free_buf_file(json_buf, input_mode);
+    coords_free(&s_coords);
+    if (!benched) {
+      return 1;
+    }
+  } else if (input_mode == INPUT_MODE_STREAM || input_mode == INPUT_MODE_PIPELINE) {
+    b32 parsed = input_mode == INPUT_MODE_STREAM
+      ? parse_coords_json_stream(in_filename, &avg)
+      : parse_coords_json_pipeline(in_filename, &avg);
+    if (!parsed) {
+      fprintf(stderr, "Error: failed to parse json file '%s'.\n", in_filename);
+      return 1;
+    }
+  } else if (input_mode == INPUT_MODE_BIN) {
+    struct coords_bin bin;
+    if (!load_coords_bin(in_filename, &bin)) {
+      fprintf(stderr, "Error: failed to load '%s'.\n", in_filename);
+      return 1;
+    }
+
+    u64 column_stride = bin.header.column_stride / sizeof(f64);
+    b32 averaged = avg_harvestine_distances_main(kernel, precision, bin.data,
+        column_stride, bin.header.pair_count, avg_thread_count, &avg);
+    b32 validated = averaged && (!validate_filename
+      || validate(validate_filename, kernel, precision, bin.data,
+          column_stride, bin.header.pair_count));
+    validated = validated && (!dists_filename
+      || write_dists(dists_filename, kernel, precision, bin.data,
+          column_stride, bin.header.pair_count));
+    validated = validated && (!verify_basename
+      || verify(verify_basename, kernel, precision, bin.data,
+          column_stride, bin.header.pair_count, avg, tolerance));
+    unload_coords_bin(bin);
+    if (!validated) {
+      return 1;
+    }
+  } else if (fused) {
+    struct buf_u8 json_buf = alloc_buf_file(in_filename, input_mode);
+    if (!json_buf.data) {
+      fprintf(stderr, "Error: failed to read '%s'.\n", in_filename);
+      return 1;
+    }
+
+    b32 parsed = parse_coords_json_fused(json_buf, kernel, precision, &avg);
+    free_buf_file(json_buf, input_mode);
+
+    if (!parsed) {
+      fprintf(stderr, "Error: failed to parse json file '%s'.\n", in_filename);
+      return 1;
+    }
+  } else {
+    if (!coords_init(&s_coords, coords_layout, huge_pages)) {
+      return 1;
+    }
+
+    struct buf_u8 json_buf = alloc_buf_file(in_filename, input_mode);
+    if (!json_buf.data) {
+      fprintf(stderr, "Error: failed to read '%s'.\n", in_filename);
+      return 1;
+    }
+
+    b32 parsed = thread_count > 1
+      ? parse_coords_json_parallel(json_buf, &s_coords, thread_count)
+      : parser->func(json_buf, &s_coords);
+    free_buf_file(json_buf, input_mode);
+
+    if (!parsed) {
+      fprintf(stderr, "Error: failed to parse json file '%s'.\n", in_filename);
+      return 1;
+    }
+
+    if (emit_bin_filename && !write_coords_bin(emit_bin_filename, &s_coords)) {
+      return 1;
+    }
+
+    b32 averaged = avg_harvestine_distances_main(kernel, precision,
+        s_coords.data, s_coords.column_stride, s_coords.size / 4,
+        avg_thread_count, &avg);
+    b32 validated = averaged && (!validate_filename
+      || validate(validate_filename, kernel, precision, s_coords.data,
+          s_coords.column_stride, s_coords.size / 4));
+    validated = validated && (!dists_filename
+      || write_dists(dists_filename, kernel, precision, s_coords.data,
+          s_coords.column_stride, s_coords.size / 4));
+    validated = validated && (!verify_basename
+      || verify(verify_basename, kernel, precision, s_coords.data,
+          s_coords.column_stride, s_coords.size / 4, avg, tolerance));
+    coords_free(&s_coords);
+    if (!validated) {
+      return 1;
+    }
+  }
 
   PROFILER_END();
 
-  PROFILER_PRINT_STATS(get_or_estimate_cpu_timer_freq(300), false);
+  // Timer frequency estimate takes 300 ms, only profiler needs it
+#ifdef PROFILER_ENABLED
+  u64 cpu_timer_freq = get_or_estimate_cpu_timer_freq(300);
+#else
+  (void)profile_csv;
+#endif // #ifdef PROFILER_ENABLED
+  if (profile_tree) {
+    PROFILER_PRINT_TREE(cpu_timer_freq, profile_csv);
+  } else {
+    PROFILER_PRINT_STATS(cpu_timer_freq, profile_csv);
+  }
+  if (profile_threads) {
+    PROFILER_PRINT_THREAD_STATS(cpu_timer_freq, profile_csv);
+  }
+  if (trace_filename && !PROFILER_TRACE_WRITE(trace_filename, cpu_timer_freq)) {
+    return 1;
+  }
+  if (folded_filename && !PROFILER_FOLDED_WRITE(folded_filename)) {
+    return 1;
+  }
+  if (bench) {
+    return 0;
+  }
+
+  if (s_parse_stats.pair_count) {
+    fprintf(stderr, "Fixed key order fast path: %llu of %llu pairs fell "
+        "back to keyed parser\n",
+        s_parse_stats.fallback_count, s_parse_stats.pair_count);
+  }
 
   FILE *out_avg = fopen(out_filename, "wb");
   if (!out_avg) {
@@ -0,0 +1,290 @@
+#include "json_scan.h"
+
+#include <string.h>     // memcpy
+
+#if defined(__x86_64__)
+#include <immintrin.h>  // _mm_* _mm256_*
+#elif defined(__aarch64__)
+#include <arm_neon.h>   // v*q_u8
+#endif
+
+// --------------------------------------
+// Classifiers
+// --------------------------------------
+
+// `[` and `{`, `]` and `}` differ only in 0x20 bit, so (c | 0x20) matches
+// both brackets and braces with a single comparison.
+
+#if defined(__x86_64__)
+
+static void json_classify_sse2(const u8 *data, u64 block_count,
+    struct json_block_masks *out_masks) {
+  const __m128i bit5      = _mm_set1_epi8(0x20);
+  const __m128i lbrace    = _mm_set1_epi8('{');
+  const __m128i rbrace    = _mm_set1_epi8('}');
+  const __m128i colon     = _mm_set1_epi8(':');
+  const __m128i comma     = _mm_set1_epi8(',');
+  const __m128i quote     = _mm_set1_epi8('"');
+  const __m128i space     = _mm_set1_epi8(' ');
+  const __m128i tab       = _mm_set1_epi8('\t');
+  const __m128i lf        = _mm_set1_epi8('\n');
+  const __m128i cr        = _mm_set1_epi8('\r');
+
+  for (u64 b = 0; b < block_count; ++b, data += JSON_SCAN_BLOCK_SIZE) {
+    struct json_block_masks m = {0};
+    for (u64 i = 0; i < JSON_SCAN_BLOCK_SIZE; i += 16) {
+      __m128i v   = _mm_loadu_si128((const __m128i *)(data + i));
+      __m128i vl  = _mm_or_si128(v, bit5);
+
+      __m128i op  = _mm_or_si128(
+          _mm_or_si128(
+            _mm_cmpeq_epi8(vl, lbrace), _mm_cmpeq_epi8(vl, rbrace)),
+          _mm_or_si128(
+            _mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+      __m128i q   = _mm_cmpeq_epi8(v, quote);
+      __m128i ws  = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+          _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+
+      m.op          |= (u64)(u16)_mm_movemask_epi8(op) << i;
+      m.quote       |= (u64)(u16)_mm_movemask_epi8(q)  << i;
+      m.whitespace  |= (u64)(u16)_mm_movemask_epi8(ws) << i;
+    }
+    out_masks[b] = m;
+  }
+}
+
+__attribute__((target("avx2")))
+static void json_classify_avx2(const u8 *data, u64 block_count,
+    struct json_block_masks *out_masks) {
+  const __m256i bit5      = _mm256_set1_epi8(0x20);
+  const __m256i lbrace    = _mm256_set1_epi8('{');
+  const __m256i rbrace    = _mm256_set1_epi8('}');
+  const __m256i colon     = _mm256_set1_epi8(':');
+  const __m256i comma     = _mm256_set1_epi8(',');
+  const __m256i quote     = _mm256_set1_epi8('"');
+  const __m256i space     = _mm256_set1_epi8(' ');
+  const __m256i tab       = _mm256_set1_epi8('\t');
+  const __m256i lf        = _mm256_set1_epi8('\n');
+  const __m256i cr        = _mm256_set1_epi8('\r');
+
+  for (u64 b = 0; b < block_count; ++b, data += JSON_SCAN_BLOCK_SIZE) {
+    struct json_block_masks m = {0};
+    for (u64 i = 0; i < JSON_SCAN_BLOCK_SIZE; i += 32) {
+      __m256i v   = _mm256_loadu_si256((const __m256i *)(data + i));
+      __m256i vl  = _mm256_or_si256(v, bit5);
+
+      __m256i op  = _mm256_or_si256(
+          _mm256_or_si256(
+            _mm256_cmpeq_epi8(vl, lbrace), _mm256_cmpeq_epi8(vl, rbrace)),
+          _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+      __m256i q   = _mm256_cmpeq_epi8(v, quote);
+      __m256i ws  = _mm256_or_si256(
+          _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+          _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+
+      m.op          |= (u64)(u32)_mm256_movemask_epi8(op) << i;
+      m.quote       |= (u64)(u32)_mm256_movemask_epi8(q)  << i;
+      m.whitespace  |= (u64)(u32)_mm256_movemask_epi8(ws) << i;
+    }
+    out_masks[b] = m;
+  }
+}
+
+#elif defined(__aarch64__)
+
+// NEON has no movemask: keep one bit per byte lane, then pairwise add
+// 4 x 16 lanes down to 64 bits.
+static FORCE_INLINE u64 neon_movemask64(uint8x16_t v0, uint8x16_t v1,
+    uint8x16_t v2, uint8x16_t v3) {
+  const uint8x16_t bits = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+  };
+  uint8x16_t s0 = vpaddq_u8(vandq_u8(v0, bits), vandq_u8(v1, bits));
+  uint8x16_t s1 = vpaddq_u8(vandq_u8(v2, bits), vandq_u8(v3, bits));
+  s0 = vpaddq_u8(s0, s1);
+  s0 = vpaddq_u8(s0, s0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+}
+
+static void json_classify_neon(const u8 *data, u64 block_count,
+    struct json_block_masks *out_masks) {
+  const uint8x16_t bit5     = vdupq_n_u8(0x20);
+  const uint8x16_t lbrace   = vdupq_n_u8('{');
+  const uint8x16_t rbrace   = vdupq_n_u8('}');
+  const uint8x16_t colon    = vdupq_n_u8(':');
+  const uint8x16_t comma    = vdupq_n_u8(',');
+  const uint8x16_t quote    = vdupq_n_u8('"');
+  const uint8x16_t space    = vdupq_n_u8(' ');
+  const uint8x16_t tab      = vdupq_n_u8('\t');
+  const uint8x16_t lf       = vdupq_n_u8('\n');
+  const uint8x16_t cr       = vdupq_n_u8('\r');
+
+  for (u64 b = 0; b < block_count; ++b, data += JSON_SCAN_BLOCK_SIZE) {
+    uint8x16_t op[4];
+    uint8x16_t q[4];
+    uint8x16_t ws[4];
+    for (u64 i = 0; i < 4; ++i) {
+      uint8x16_t v  = vld1q_u8(data + i * 16);
+      uint8x16_t vl = vorrq_u8(v, bit5);
+
+      op[i] = vorrq_u8(
+          vorrq_u8(vceqq_u8(vl, lbrace), vceqq_u8(vl, rbrace)),
+          vorrq_u8(vceqq_u8(v, colon), vceqq_u8(v, comma)));
+      q[i]  = vceqq_u8(v, quote);
+      ws[i] = vorrq_u8(
+          vorrq_u8(vceqq_u8(v, space), vceqq_u8(v, tab)),
+          vorrq_u8(vceqq_u8(v, lf), vceqq_u8(v, cr)));
+    }
+
+    out_masks[b] = (struct json_block_masks){
+      .op         = neon_movemask64(op[0], op[1], op[2], op[3]),
+      .quote      = neon_movemask64(q[0], q[1], q[2], q[3]),
+      .whitespace = neon_movemask64(ws[0], ws[1], ws[2], ws[3]),
+    };
+  }
+}
+
+#else
+
+static void json_classify_scalar(const u8 *data, u64 block_count,
+    struct json_block_masks *out_masks) {
+  for (u64 b = 0; b < block_count; ++b, data += JSON_SCAN_BLOCK_SIZE) {
+    struct json_block_masks m = {0};
+    for (u64 i = 0; i < JSON_SCAN_BLOCK_SIZE; ++i) {
+      u8 c = data[i];
+      u8 cl = c | 0x20;
+      u64 op = cl == '{' || cl == '}' || c == ':' || c == ',';
+      u64 ws = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+      m.op          |= op << i;
+      m.quote       |= (u64)(c == '"') << i;
+      m.whitespace  |= ws << i;
+    }
+    out_masks[b] = m;
+  }
+}
+
+#endif // #if defined(__x86_64__) #elif defined(__aarch64__)
+
+struct json_classifier {
+  const char *name;
+  json_classify_func_t *func;
+};
+
+static struct json_classifier json_classifier_pick(void) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return (struct json_classifier){"avx2", json_classify_avx2};
+  }
+  return (struct json_classifier){"sse2", json_classify_sse2};
+#elif defined(__aarch64__)
+  // Advanced SIMD is mandatory on AArch64
+  return (struct json_classifier){"neon", json_classify_neon};
+#else
+  return (struct json_classifier){"scalar", json_classify_scalar};
+#endif
+}
+
+// --------------------------------------
+// Scanner
+// --------------------------------------
+
+// Bit i is set if there is odd number of set bits in [0, i] of `x`.
+// Turns quote bits into "inside of a string" mask: opening quote up to, but
+// not including closing quote.
+static FORCE_INLINE u64 prefix_xor(u64 x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+const char *json_scanner_isa_name(void) {
+  return json_classifier_pick().name;
+}
+
+void json_scanner_init(struct json_scanner *s, u8 *begin, u8 *end) {
+  // __builtin_cpu_supports() is not free, don't call it per window
+  static json_classify_func_t *s_classify;
+  if (!s_classify) {
+    s_classify = json_classifier_pick().func;
+  }
+
+  s->classify = s_classify;
+  s->cur = begin;
+  s->end = end;
+  s->index_base = begin;
+  s->index_count = 0;
+  s->index_pos = 0;
+  s->prev_in_string = 0;
+  s->prev_scalar = 0;
+}
+
+b32 json_scanner_fill(struct json_scanner *s) {
+  if (s->cur >= s->end) {
+    return false;
+  }
+
+  json_classify_func_t *classify = s->classify;
+
+  u64 size = MIN((u64)(s->end - s->cur), (u64)JSON_SCAN_WINDOW_SIZE);
+  u64 block_count = size / JSON_SCAN_BLOCK_SIZE;
+  u64 tail_size = size % JSON_SCAN_BLOCK_SIZE;
+
+  classify(s->cur, block_count, s->masks);
+
+  // Don't read past the end of input: classify zero padded copy of the tail
+  if (tail_size) {
+    u8 tail[JSON_SCAN_BLOCK_SIZE] = {0};
+    memcpy(tail, s->cur + block_count * JSON_SCAN_BLOCK_SIZE, tail_size);
+    classify(tail, 1, s->masks + block_count);
+
+    // Padding is whitespace, so it's neither structural nor a scalar
+    u64 padding = ~((1LLU << tail_size) - 1);
+    s->masks[block_count].op          &= ~padding;
+    s->masks[block_count].quote       &= ~padding;
+    s->masks[block_count].whitespace  |= padding;
+    ++block_count;
+  }
+
+  u32 index_count = 0;
+  for (u64 b = 0; b < block_count; ++b) {
+    struct json_block_masks m = s->masks[b];
+
+    u64 in_string = prefix_xor(m.quote) ^ s->prev_in_string;
+    s->prev_in_string = (u64)((i64)in_string >> 63);
+
+    u64 structural = (m.op & ~in_string) | m.quote;
+    u64 scalar = ~(m.op | m.quote | m.whitespace | in_string);
+    u64 scalar_start = scalar & ~((scalar << 1) | s->prev_scalar);
+    s->prev_scalar = scalar >> 63;
+
+    // Positions are written in groups of 8 regardless of the count, so the
+    // loop branch depends on the number of groups, not on every bit
+    u64 bits = structural | scalar_start;
+    u32 base = b * JSON_SCAN_BLOCK_SIZE;
+    u32 count = __builtin_popcountll(bits);
+    u32 *out = s->index + index_count;
+    while (bits) {
+      for (u32 i = 0; i < 8; ++i) {
+        out[i] = base + __builtin_ctzll(bits | 1LLU << 63);
+        bits &= bits - 1;
+      }
+      out += 8;
+    }
+    index_count += count;
+  }
+
+  s->index_base = s->cur;
+  s->index_count = index_count;
+  s->index_pos = 0;
+  s->cur += size;
+  return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "types.h"
+
+// JSON structural scanner (simdjson style stage 1)
+// https://arxiv.org/abs/1902.08318
+//
+// Input is classified 64 bytes at a time with SIMD into bitmasks of
+// structural characters `{}[]:,`, quotes and whitespaces. Bitmasks are then
+// turned into an index of positions of:
+// * structural characters and quotes outside of strings
+// * scalar starts: first byte of number or literal (true, false, null)
+//
+// Stage 2 (parser) jumps from one indexed position to the next instead of
+// scanning every byte.
+//
+// Input is indexed in windows of JSON_SCAN_WINDOW_SIZE bytes on demand,
+// so index memory doesn't depend on input size.
+//
+// NOTE: escaped quotes `\"` inside of strings are not supported.
+//
+// Scanner is about 90 KB, allocate it or keep it off the stack of deep
+// call chains.
+//
+// Usage:
+//  struct json_scanner *s = malloc(sizeof(*s));
+//  json_scanner_init(s, begin, end);
+//  for (u8 *p; (p = json_scanner_next(s));) {
+//    ...
+//  }
+//  free(s);
+
+enum {
+  JSON_SCAN_BLOCK_SIZE  = 64,
+  JSON_SCAN_WINDOW_SIZE = 16 * 1024,
+  JSON_SCAN_WINDOW_BLOCK_COUNT = JSON_SCAN_WINDOW_SIZE / JSON_SCAN_BLOCK_SIZE,
+};
+
+// Classification bitmasks of a 64 byte block. Bit i corresponds to byte i.
+struct json_block_masks {
+  u64 op;           // {}[]:,
+  u64 quote;        // "
+  u64 whitespace;   // space \t \n \r
+};
+
+// Classify `block_count` blocks of 64 bytes starting at `data`
+typedef void json_classify_func_t(const u8 *data, u64 block_count,
+    struct json_block_masks *out_masks);
+
+struct json_scanner {
+  u8 *cur;          // beginning of not yet indexed input
+  u8 *end;
+
+  u8 *index_base;   // index holds offsets relative to index_base
+  u32 index_count;
+  u32 index_pos;
+
+  u64 prev_in_string; // all ones if previous block ended inside of a string
+  u64 prev_scalar;    // 1 if previous block ended with a scalar byte
+
+  json_classify_func_t *classify; // picked for this CPU once at init
+
+  // Positions are written 8 at a time, up to 7 past index_count
+  u32 index[JSON_SCAN_WINDOW_SIZE + 8];
+  struct json_block_masks masks[JSON_SCAN_WINDOW_BLOCK_COUNT];
+};
+
+// Name of the classifier picked for this CPU
+const char *json_scanner_isa_name(void);
+
+void json_scanner_init(struct json_scanner *s, u8 *begin, u8 *end);
+
+// Index next window of input.
+// Returns false if there is no more input.
+b32 json_scanner_fill(struct json_scanner *s);
+
+// Returns position of the next structural character or scalar start.
+// Returns 0 at the end of input.
+static FORCE_INLINE u8 *json_scanner_next(struct json_scanner *s) {
+  if (UNLIKELY(s->index_pos == s->index_count)) {
+    do {
+      if (!json_scanner_fill(s)) {
+        return 0;
+      }
+    } while (!s->index_count);
+  }
+  return s->index_base + s->index[s->index_pos++];
+}
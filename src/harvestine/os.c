@@ -14,6 +14,18 @@
 // Perf counters
 // --------------------------------------
 
+const char *os_pmc_name(enum os_pmc kind) {
+  static const char * const s_names[OS_PMC_COUNT] = {
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+    "stalled_cycles",
+  };
+  return kind < OS_PMC_COUNT ? s_names[kind] : "unknown";
+}
+
 #if _WIN32
 #include <psapi.h>                // GetProcessMemoryInfo GetCurrentProcessId
 
@@ -50,6 +62,18 @@ u64 os_get_page_size(void) {
   return 4 * 1024 * 1024;
 }
 
+// TODO: not implemented, needs a kernel driver
+b32 os_pmc_open(struct os_pmc_group *out_group, u32 kind_mask) {
+  *out_group = (struct os_pmc_group){0};
+  return false;
+}
+
+void os_pmc_read(const struct os_pmc_group *group, u64 *out_values) {
+}
+
+void os_pmc_close(struct os_pmc_group *group) {
+}
+
 #elif __APPLE__
 
 #include <sys/resource.h>         // getrusage
@@ -71,14 +95,31 @@ u64 os_get_page_size(void) {
   return getpagesize();
 }
 
+// TODO: not implemented, kperf is a private framework
+b32 os_pmc_open(struct os_pmc_group *out_group, u32 kind_mask) {
+  *out_group = (struct os_pmc_group){0};
+  return false;
+}
+
+void os_pmc_read(const struct os_pmc_group *group, u64 *out_values) {
+}
+
+void os_pmc_close(struct os_pmc_group *group) {
+}
+
 #else
 
 #include <linux/hw_breakpoint.h>  // HW_*
 #include <linux/perf_event.h>     // PERF_*
 #include <sys/ioctl.h>            // ioctl
+#include <sys/mman.h>             // mmap munmap
 #include <sys/syscall.h>          // SYS_*
 #include <sys/types.h>            // pid_t
-#include <unistd.h>               // syscall read getpagesize
+#include <unistd.h>               // syscall read close getpagesize
+
+#if __x86_64__
+#include <x86intrin.h>            // __rdpmc
+#endif // #if __x86_64__
 
 struct os {
   i32 pe_page_fault_fd; // perf event: page faults
@@ -131,6 +172,110 @@ u64 os_get_page_size(void) {
   return getpagesize();
 }
 
+b32 os_pmc_open(struct os_pmc_group *out_group, u32 kind_mask) {
+  static const struct {u32 type; u64 config;} s_events[OS_PMC_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+      | PERF_COUNT_HW_CACHE_OP_READ << 8
+      | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+  };
+
+  struct os_pmc_group g = {0};
+  for (u32 kind = 0; kind < OS_PMC_COUNT; ++kind) {
+    if (!(kind_mask & 1 << kind)) {
+      continue;
+    }
+
+    struct perf_event_attr attr = {
+      .size = sizeof(attr),
+      .type = s_events[kind].type,
+      .config = s_events[kind].config,
+      .exclude_kernel = 1,
+      .exclude_hv = 1,
+    };
+    i32 fd = perf_event_open(
+        &attr,
+        0, -1,  // pid == 0, cpu == -1: measure calling thread on all CPUs
+        g.count ? g.fds[0] : -1,  // the first counter is group leader
+        PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1) {
+      continue; // not supported by CPU or not allowed
+    }
+
+    // Counter index and offset are published in the first page
+    void *page = mmap(0, getpagesize(), PROT_READ, MAP_SHARED, fd, 0);
+    if (page != MAP_FAILED
+        && !((struct perf_event_mmap_page *)page)->cap_user_rdpmc) {
+      munmap(page, getpagesize());
+      page = MAP_FAILED;
+    }
+
+    g.kinds[g.count]  = kind;
+    g.fds[g.count]    = fd;
+    g.pages[g.count]  = page != MAP_FAILED ? page : 0;
+    ++g.count;
+  }
+
+  *out_group = g;
+  return g.count != 0;
+}
+
+// Seqlock protocol from linux/perf_event.h
+static u64 os_pmc_read_one(const struct os_pmc_group *group, u32 i) {
+#if __x86_64__
+  volatile struct perf_event_mmap_page *pc = group->pages[i];
+  if (pc) {
+    u32 seq;
+    u32 index;
+    u64 count;
+    do {
+      seq = pc->lock;
+      __asm__ volatile("" ::: "memory");
+      index = pc->index;
+      count = pc->offset;
+      if (index) {
+        // Sign extend counter of `pmc_width` bits
+        u32 shift = 64 - pc->pmc_width;
+        count += (u64)((i64)((u64)__rdpmc(index - 1) << shift) >> shift);
+      }
+      __asm__ volatile("" ::: "memory");
+    } while (pc->lock != seq);
+
+    if (index) {
+      return count;
+    }
+    // Counter is not on the PMU right now, kernel has the value
+  }
+#endif // #if __x86_64__
+
+  u64 value = 0;
+  if (read(group->fds[i], &value, sizeof(value)) != sizeof(value)) {
+    value = 0;
+  }
+  return value;
+}
+
+void os_pmc_read(const struct os_pmc_group *group, u64 *out_values) {
+  for (u32 i = 0; i < group->count; ++i) {
+    out_values[i] = os_pmc_read_one(group, i);
+  }
+}
+
+void os_pmc_close(struct os_pmc_group *group) {
+  // Members first, leader last
+  for (u32 i = group->count; i-- > 0;) {
+    if (group->pages[i]) {
+      munmap(group->pages[i], getpagesize());
+    }
+    close(group->fds[i]);
+  }
+  *group = (struct os_pmc_group){0};
+}
+
 #endif // #if _WIN32
 
 // --------------------------------------
@@ -161,6 +306,24 @@ b32 os_virtual_unlock(void *p, u64 size) {
   return false;
 }
 
+b32 os_virtual_advise_sequential(void *p, u64 size) {
+  // TODO implement me with PrefetchVirtualMemory()
+  return false;
+}
+
+void *os_virtual_reserve(u64 size) {
+  return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+b32 os_virtual_commit(void *p, u64 size) {
+  return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+
+b32 os_virtual_advise_huge_pages(void *p, u64 size) {
+  // Large pages can't be committed on demand on Windows
+  return false;
+}
+
 // TODO: not tested
 void os_print_last_error(const char *msg) {
   if (msg) {
@@ -222,11 +385,48 @@ b32 os_file_munmap(struct os_buf buf) {
   return UnmapViewOfFile(buf.data);
 }
 
+struct os_buf os_file_mmap_padded(const char *filepath, u64 padding) {
+  // TODO implement me with VirtualAlloc2() placeholder and
+  // MapViewOfFile3()
+  return (struct os_buf){0};
+}
+
+b32 os_file_munmap_padded(struct os_buf buf, u64 padding) {
+  // TODO implement me
+  return false;
+}
+
+b32 os_file_create(struct os_file *out_file, const char *filepath) {
+  HANDLE h = CreateFileA(filepath, GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+      FILE_ATTRIBUTE_NORMAL, 0);
+  out_file->handle = (u64)h;
+  return h != INVALID_HANDLE_VALUE;
+}
+
+b32 os_file_write(struct os_file file, const void *data, u64 size) {
+  const u8 *cur = data;
+  while (size) {
+    DWORD chunk_size = size > 0x80000000LLU ? 0x80000000LU : (DWORD)size;
+    DWORD written = 0;
+    if (!WriteFile((HANDLE)file.handle, cur, chunk_size, &written, 0)) {
+      return false;
+    }
+    cur += written;
+    size -= written;
+  }
+  return true;
+}
+
+b32 os_file_close(struct os_file file) {
+  return CloseHandle((HANDLE)file.handle);
+}
+
 #else
 
 #include <sys/stat.h>             // stat
-#include <sys/mman.h>             // mmap munmap mlock munlock
+#include <sys/mman.h>             // mmap munmap mlock munlock madvise
 #include <fcntl.h>                // open
+#include <unistd.h>               // write close
 
 #if __APPLE__
 #include <mach/mach_vm.h>
@@ -312,6 +512,35 @@ b32 os_virtual_unlock(void *p, u64 size) {
   return munlock(p, size) != -1;
 }
 
+b32 os_virtual_advise_sequential(void *p, u64 size) {
+  return madvise(p, size, MADV_SEQUENTIAL) != -1;
+}
+
+void *os_virtual_reserve(u64 size) {
+  void *m;
+  int flags = MAP_PRIVATE | MAP_ANON;
+#if __linux__
+  // Don't account reserved address space against overcommit limits
+  flags |= MAP_NORESERVE;
+#endif // #if __linux__
+  m = mmap(0, size, PROT_NONE, flags, -1, 0);
+  m = remap_mmap_failure_to_zero(m);
+  return m;
+}
+
+b32 os_virtual_commit(void *p, u64 size) {
+  return mprotect(p, size, PROT_READ | PROT_WRITE) != -1;
+}
+
+b32 os_virtual_advise_huge_pages(void *p, u64 size) {
+#if __linux__
+  return madvise(p, size, MADV_HUGEPAGE) != -1;
+#else
+  // TODO: macOS superpages can't be requested for existing mapping
+  return false;
+#endif // #if __linux__
+}
+
 void os_print_last_error(const char *msg) {
   perror(msg);
 }
@@ -346,4 +575,171 @@ b32 os_file_munmap(struct os_buf buf) {
   return munmap(buf.data, buf.size) != -1;
 }
 
+struct os_buf os_file_mmap_padded(const char *filepath, u64 padding) {
+  struct os_buf ret = {0};
+
+  int fd = open(filepath, O_RDONLY);
+  if (fd != -1) {
+    struct stat st;
+    if (!fstat(fd, &st)) {
+      if (st.st_size > 0) {
+        // Reserve zero pages for file content and padding, then map the file
+        // over them. The rest of the last file page is zero filled by mmap.
+        u64 map_size = align(st.st_size + padding, os_get_page_size());
+        void *m = mmap(0, map_size, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+        m = remap_mmap_failure_to_zero(m);
+        if (m && mmap(m, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+              fd, 0) == MAP_FAILED) {
+          munmap(m, map_size);
+          m = 0;
+        }
+        if (m) {
+          ret.data = m;
+          ret.size = st.st_size;
+        }
+      }
+    }
+    close(fd);
+  }
+
+  return ret;
+}
+
+b32 os_file_munmap_padded(struct os_buf buf, u64 padding) {
+  return munmap(buf.data, align(buf.size + padding, os_get_page_size())) != -1;
+}
+
+b32 os_file_create(struct os_file *out_file, const char *filepath) {
+  int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  out_file->handle = (u64)fd;
+  return fd != -1;
+}
+
+b32 os_file_write(struct os_file file, const void *data, u64 size) {
+  const u8 *cur = data;
+  while (size) {
+    ssize_t written = write((int)file.handle, cur, size);
+    if (written < 0) {
+      return false;
+    }
+    cur += written;
+    size -= written;
+  }
+  return true;
+}
+
+b32 os_file_close(struct os_file file) {
+  return close((int)file.handle) != -1;
+}
+
+#endif // #if _WIN32
+
+// --------------------------------------
+// Threads
+// --------------------------------------
+
+#if _WIN32
+
+b32 os_thread_start(struct os_thread *out_thread, os_thread_func_t *func,
+    void *arg) {
+  HANDLE h = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)func, arg, 0, 0);
+  out_thread->handle = (u64)h;
+  return h != 0;
+}
+
+b32 os_thread_join(struct os_thread thread) {
+  HANDLE h = (HANDLE)thread.handle;
+  b32 ret = WaitForSingleObject(h, INFINITE) == WAIT_OBJECT_0;
+  CloseHandle(h);
+  return ret;
+}
+
+void os_thread_yield(void) {
+  SwitchToThread();
+}
+
+// WaitOnAddress WakeByAddressAll, other toolchains link with -lsynchronization
+#ifdef _MSC_VER
+#pragma comment(lib, "Synchronization.lib")
+#endif // #ifdef _MSC_VER
+
+void os_wait(_Atomic u32 *addr, u32 expected) {
+  WaitOnAddress((volatile void *)addr, &expected, sizeof(expected), INFINITE);
+}
+
+void os_wake_all(_Atomic u32 *addr) {
+  WakeByAddressAll((void *)addr);
+}
+
+#else
+
+#include <pthread.h>              // pthread_create pthread_join
+#include <sched.h>                // sched_yield
+
+b32 os_thread_start(struct os_thread *out_thread, os_thread_func_t *func,
+    void *arg) {
+  pthread_t thread;
+  b32 ret = pthread_create(&thread, 0, func, arg) == 0;
+  out_thread->handle = (u64)thread;
+  return ret;
+}
+
+b32 os_thread_join(struct os_thread thread) {
+  return pthread_join((pthread_t)thread.handle, 0) == 0;
+}
+
+void os_thread_yield(void) {
+  sched_yield();
+}
+
+#if __APPLE__
+
+// Private, but stable since macOS 10.12, libc++ atomic wait is built on it
+int __ulock_wait(u32 operation, void *addr, u64 value, u32 timeout_us);
+int __ulock_wake(u32 operation, void *addr, u64 wake_value);
+enum {
+  OS_UL_COMPARE_AND_WAIT  = 1,
+  OS_ULF_WAKE_ALL         = 0x100,
+  OS_ULF_NO_ERRNO         = 0x1000000,
+};
+
+void os_wait(_Atomic u32 *addr, u32 expected) {
+  __ulock_wait(OS_UL_COMPARE_AND_WAIT | OS_ULF_NO_ERRNO, (void *)addr,
+      expected, 0);
+}
+
+void os_wake_all(_Atomic u32 *addr) {
+  __ulock_wake(OS_UL_COMPARE_AND_WAIT | OS_ULF_WAKE_ALL | OS_ULF_NO_ERRNO,
+      (void *)addr, 0);
+}
+
+#elif __linux__
+
+#include <limits.h>               // INT_MAX
+#include <linux/futex.h>          // FUTEX_WAIT_PRIVATE FUTEX_WAKE_PRIVATE
+#include <sys/syscall.h>          // SYS_futex
+#include <unistd.h>               // syscall
+
+void os_wait(_Atomic u32 *addr, u32 expected) {
+  syscall(SYS_futex, (void *)addr, FUTEX_WAIT_PRIVATE, expected, 0, 0, 0);
+}
+
+void os_wake_all(_Atomic u32 *addr) {
+  syscall(SYS_futex, (void *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+}
+
+#else
+
+void os_wait(_Atomic u32 *addr, u32 expected) {
+  (void)addr;
+  (void)expected;
+  sched_yield();
+}
+
+void os_wake_all(_Atomic u32 *addr) {
+  (void)addr;
+}
+
+#endif // #if __APPLE__
+
 #endif // #if _WIN32
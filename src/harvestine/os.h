@@ -15,6 +15,43 @@ u64 os_read_page_fault_count(void);
 // Get page size
 u64 os_get_page_size(void);
 
+// Hardware performance counters
+enum os_pmc {
+  OS_PMC_CYCLES,
+  OS_PMC_INSTRUCTIONS,
+  OS_PMC_L1D_MISSES,        // L1 data cache read misses
+  OS_PMC_LLC_MISSES,        // last level cache misses
+  OS_PMC_BRANCH_MISSES,
+  OS_PMC_STALLED_CYCLES,    // cycles with stalled backend
+
+  OS_PMC_COUNT,
+};
+
+// Counters of the calling thread opened as a single group, so they are
+// scheduled on the PMU together.
+// Linux: perf_event pages are mmapped and counters are read with rdpmc in
+// user space, if kernel doesn't allow rdpmc, with read() syscall.
+struct os_pmc_group {
+  u32 count;                        // opened counters
+  u32 kinds[OS_PMC_COUNT];          // enum os_pmc of opened counters
+  i32 fds[OS_PMC_COUNT];
+  void *pages[OS_PMC_COUNT];        // 0 - counter is read with read()
+};
+
+// Returns name of counter, e.g. "l1d_misses"
+const char *os_pmc_name(enum os_pmc kind);
+
+// Open counters of `kind_mask` (bit `1 << enum os_pmc` per counter) for
+// the calling thread. Counters that CPU or kernel don't support are skipped.
+// Returns false if no counter could be opened.
+b32 os_pmc_open(struct os_pmc_group *out_group, u32 kind_mask);
+
+// Read opened counters to `out_values` in `group->kinds` order.
+// Should be called on the thread that opened the group.
+void os_pmc_read(const struct os_pmc_group *group, u64 *out_values);
+
+void os_pmc_close(struct os_pmc_group *group);
+
 // --------------------------------------
 // Virtual memory
 // --------------------------------------
@@ -45,6 +82,28 @@ b32 os_virtual_lock(void *p, u64 size);
 // Returns false on failure.
 b32 os_virtual_unlock(void *p, u64 size);
 
+// Reserve address space of size in bytes without any access rights.
+// No physical pages or swap are allocated until pages are committed.
+// Release with os_virtual_free().
+// Returns 0 on failure.
+void *os_virtual_reserve(u64 size);
+
+// Commit reserved pages for read and write. Pages are zero filled and
+// physical memory is allocated on first touch.
+// `p` and `size` should be aligned to page size.
+// Returns false on failure.
+b32 os_virtual_commit(void *p, u64 size);
+
+// Hint OS to back memory with huge pages (Linux: Transparent Huge Pages).
+// `p` and `size` should be aligned to large page size.
+// Returns false on failure or if not supported.
+b32 os_virtual_advise_huge_pages(void *p, u64 size);
+
+// Hint OS that memory is going to be accessed sequentially, so it can
+// aggressively read ahead pages of a mapped file and free pages behind.
+// Returns false on failure.
+b32 os_virtual_advise_sequential(void *p, u64 size);
+
 // --------------------------------------
 // File System
 // --------------------------------------
@@ -66,6 +125,64 @@ struct os_buf os_file_mmap(const char *filepath);
 // Returns false on failure.
 b32 os_file_munmap(struct os_buf buf);
 
+// Return file memory map followed by at least `padding` zero bytes.
+// Padding pages are mapped right after the file, so reading past the end of
+// file content up to `padding` bytes is safe.
+// Returns data = 0 and size = 0 on failure or if file is empty.
+struct os_buf os_file_mmap_padded(const char *filepath, u64 padding);
+
+// Unmap file memory map, previously created with os_file_mmap_padded().
+// `padding` should match the one passed to os_file_mmap_padded().
+// Returns false on failure.
+b32 os_file_munmap_padded(struct os_buf buf, u64 padding);
+
+struct os_file {
+  u64 handle;
+};
+
+// Create or truncate file for writing.
+// Returns false on failure.
+b32 os_file_create(struct os_file *out_file, const char *filepath);
+
+// Write `size` bytes with a single syscall, unless OS writes less than
+// asked, then the rest is written with more calls.
+// Returns false on failure.
+b32 os_file_write(struct os_file file, const void *data, u64 size);
+
+// Returns false on failure.
+b32 os_file_close(struct os_file file);
+
+// --------------------------------------
+// Threads
+// --------------------------------------
+
+struct os_thread {
+  u64 handle;
+};
+
+typedef void *os_thread_func_t(void *arg);
+
+// Start a new thread running `func(arg)`.
+// Returns false on failure.
+b32 os_thread_start(struct os_thread *out_thread, os_thread_func_t *func,
+    void *arg);
+
+// Wait for thread to finish.
+// Returns false on failure.
+b32 os_thread_join(struct os_thread thread);
+
+// Give up the rest of the time slice to other threads.
+void os_thread_yield(void);
+
+// Block calling thread while `*addr == expected`, until os_wake_all() on
+// `addr`. May return spuriously, recheck the condition in a loop.
+// futex on Linux, __ulock on macOS, WaitOnAddress on Windows, yield on the
+// rest.
+void os_wait(_Atomic u32 *addr, u32 expected);
+
+// Wake all threads blocked in os_wait() on `addr`.
+void os_wake_all(_Atomic u32 *addr);
+
 // Validator logs errors and traps on errors
 struct os_validator {
   int (*log_error)(const char *); // puts wors just fine for now
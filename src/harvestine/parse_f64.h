@@ -0,0 +1,314 @@
+#pragma once
+
+#include "types.h"
+
+#include <stdlib.h>     // strtod
+
+// Decimal to f64 parser
+//
+// Replacement for strtod() for plain decimal numbers `[-]digits[.digits]`
+// produced by gen_harvestine. Doesn't skip whitespaces and doesn't check
+// locale. Results are correctly rounded (same bits as strtod()):
+// * Clinger fast path: up to 2^53 mantissa and |exp10| <= 22, both are exact
+//   f64, so a single multiplication or division is correctly rounded.
+// * Eisel-Lemire: 64 bit mantissa times 128 bit truncated power of 5, bails
+//   out when the product is too close to a halfway point.
+//   https://arxiv.org/abs/2101.11408
+// * Everything else (exponents, inf/nan, hex floats, subnormals, more than 19
+//   significant digits that can't be decided, powers out of the table range)
+//   falls back to strtod().
+//
+// Usage:
+//  f64 d;
+//  u8 *end = parse_f64(p, &d);
+//  if (end == p) {
+//    // not a number
+//  }
+
+// `__extension__` silences -Wpedantic
+__extension__ typedef unsigned __int128 parse_f64_u128;
+
+enum {
+  PARSE_F64_POW5_MIN = -64,
+  PARSE_F64_POW5_MAX = 64,
+};
+
+// Normalized 128 bit approximations of 5^q, q in
+// [PARSE_F64_POW5_MIN, PARSE_F64_POW5_MAX]: {high 64 bits, low 64 bits}.
+// Negative powers are rounded up, positive powers are truncated.
+// Generated with fast_float script/table_generation.py
+static const u64 s_parse_f64_pow5[][2] = {
+  {0xa87fea27a539e9a5LLU, 0x3f2398d747b36224LLU}, // 5^-64
+  {0xd29fe4b18e88640eLLU, 0x8eec7f0d19a03aadLLU}, // 5^-63
+  {0x83a3eeeef9153e89LLU, 0x1953cf68300424acLLU}, // 5^-62
+  {0xa48ceaaab75a8e2bLLU, 0x5fa8c3423c052dd7LLU}, // 5^-61
+  {0xcdb02555653131b6LLU, 0x3792f412cb06794dLLU}, // 5^-60
+  {0x808e17555f3ebf11LLU, 0xe2bbd88bbee40bd0LLU}, // 5^-59
+  {0xa0b19d2ab70e6ed6LLU, 0x5b6aceaeae9d0ec4LLU}, // 5^-58
+  {0xc8de047564d20a8bLLU, 0xf245825a5a445275LLU}, // 5^-57
+  {0xfb158592be068d2eLLU, 0xeed6e2f0f0d56712LLU}, // 5^-56
+  {0x9ced737bb6c4183dLLU, 0x55464dd69685606bLLU}, // 5^-55
+  {0xc428d05aa4751e4cLLU, 0xaa97e14c3c26b886LLU}, // 5^-54
+  {0xf53304714d9265dfLLU, 0xd53dd99f4b3066a8LLU}, // 5^-53
+  {0x993fe2c6d07b7fabLLU, 0xe546a8038efe4029LLU}, // 5^-52
+  {0xbf8fdb78849a5f96LLU, 0xde98520472bdd033LLU}, // 5^-51
+  {0xef73d256a5c0f77cLLU, 0x963e66858f6d4440LLU}, // 5^-50
+  {0x95a8637627989aadLLU, 0xdde7001379a44aa8LLU}, // 5^-49
+  {0xbb127c53b17ec159LLU, 0x5560c018580d5d52LLU}, // 5^-48
+  {0xe9d71b689dde71afLLU, 0xaab8f01e6e10b4a6LLU}, // 5^-47
+  {0x9226712162ab070dLLU, 0xcab3961304ca70e8LLU}, // 5^-46
+  {0xb6b00d69bb55c8d1LLU, 0x3d607b97c5fd0d22LLU}, // 5^-45
+  {0xe45c10c42a2b3b05LLU, 0x8cb89a7db77c506aLLU}, // 5^-44
+  {0x8eb98a7a9a5b04e3LLU, 0x77f3608e92adb242LLU}, // 5^-43
+  {0xb267ed1940f1c61cLLU, 0x55f038b237591ed3LLU}, // 5^-42
+  {0xdf01e85f912e37a3LLU, 0x6b6c46dec52f6688LLU}, // 5^-41
+  {0x8b61313bbabce2c6LLU, 0x2323ac4b3b3da015LLU}, // 5^-40
+  {0xae397d8aa96c1b77LLU, 0xabec975e0a0d081aLLU}, // 5^-39
+  {0xd9c7dced53c72255LLU, 0x96e7bd358c904a21LLU}, // 5^-38
+  {0x881cea14545c7575LLU, 0x7e50d64177da2e54LLU}, // 5^-37
+  {0xaa242499697392d2LLU, 0xdde50bd1d5d0b9e9LLU}, // 5^-36
+  {0xd4ad2dbfc3d07787LLU, 0x955e4ec64b44e864LLU}, // 5^-35
+  {0x84ec3c97da624ab4LLU, 0xbd5af13bef0b113eLLU}, // 5^-34
+  {0xa6274bbdd0fadd61LLU, 0xecb1ad8aeacdd58eLLU}, // 5^-33
+  {0xcfb11ead453994baLLU, 0x67de18eda5814af2LLU}, // 5^-32
+  {0x81ceb32c4b43fcf4LLU, 0x80eacf948770ced7LLU}, // 5^-31
+  {0xa2425ff75e14fc31LLU, 0xa1258379a94d028dLLU}, // 5^-30
+  {0xcad2f7f5359a3b3eLLU, 0x096ee45813a04330LLU}, // 5^-29
+  {0xfd87b5f28300ca0dLLU, 0x8bca9d6e188853fcLLU}, // 5^-28
+  {0x9e74d1b791e07e48LLU, 0x775ea264cf55347eLLU}, // 5^-27
+  {0xc612062576589ddaLLU, 0x95364afe032a819eLLU}, // 5^-26
+  {0xf79687aed3eec551LLU, 0x3a83ddbd83f52205LLU}, // 5^-25
+  {0x9abe14cd44753b52LLU, 0xc4926a9672793543LLU}, // 5^-24
+  {0xc16d9a0095928a27LLU, 0x75b7053c0f178294LLU}, // 5^-23
+  {0xf1c90080baf72cb1LLU, 0x5324c68b12dd6339LLU}, // 5^-22
+  {0x971da05074da7beeLLU, 0xd3f6fc16ebca5e04LLU}, // 5^-21
+  {0xbce5086492111aeaLLU, 0x88f4bb1ca6bcf585LLU}, // 5^-20
+  {0xec1e4a7db69561a5LLU, 0x2b31e9e3d06c32e6LLU}, // 5^-19
+  {0x9392ee8e921d5d07LLU, 0x3aff322e62439fd0LLU}, // 5^-18
+  {0xb877aa3236a4b449LLU, 0x09befeb9fad487c3LLU}, // 5^-17
+  {0xe69594bec44de15bLLU, 0x4c2ebe687989a9b4LLU}, // 5^-16
+  {0x901d7cf73ab0acd9LLU, 0x0f9d37014bf60a11LLU}, // 5^-15
+  {0xb424dc35095cd80fLLU, 0x538484c19ef38c95LLU}, // 5^-14
+  {0xe12e13424bb40e13LLU, 0x2865a5f206b06fbaLLU}, // 5^-13
+  {0x8cbccc096f5088cbLLU, 0xf93f87b7442e45d4LLU}, // 5^-12
+  {0xafebff0bcb24aafeLLU, 0xf78f69a51539d749LLU}, // 5^-11
+  {0xdbe6fecebdedd5beLLU, 0xb573440e5a884d1cLLU}, // 5^-10
+  {0x89705f4136b4a597LLU, 0x31680a88f8953031LLU}, // 5^-9
+  {0xabcc77118461cefcLLU, 0xfdc20d2b36ba7c3eLLU}, // 5^-8
+  {0xd6bf94d5e57a42bcLLU, 0x3d32907604691b4dLLU}, // 5^-7
+  {0x8637bd05af6c69b5LLU, 0xa63f9a49c2c1b110LLU}, // 5^-6
+  {0xa7c5ac471b478423LLU, 0x0fcf80dc33721d54LLU}, // 5^-5
+  {0xd1b71758e219652bLLU, 0xd3c36113404ea4a9LLU}, // 5^-4
+  {0x83126e978d4fdf3bLLU, 0x645a1cac083126eaLLU}, // 5^-3
+  {0xa3d70a3d70a3d70aLLU, 0x3d70a3d70a3d70a4LLU}, // 5^-2
+  {0xccccccccccccccccLLU, 0xcccccccccccccccdLLU}, // 5^-1
+  {0x8000000000000000LLU, 0x0000000000000000LLU}, // 5^0
+  {0xa000000000000000LLU, 0x0000000000000000LLU}, // 5^1
+  {0xc800000000000000LLU, 0x0000000000000000LLU}, // 5^2
+  {0xfa00000000000000LLU, 0x0000000000000000LLU}, // 5^3
+  {0x9c40000000000000LLU, 0x0000000000000000LLU}, // 5^4
+  {0xc350000000000000LLU, 0x0000000000000000LLU}, // 5^5
+  {0xf424000000000000LLU, 0x0000000000000000LLU}, // 5^6
+  {0x9896800000000000LLU, 0x0000000000000000LLU}, // 5^7
+  {0xbebc200000000000LLU, 0x0000000000000000LLU}, // 5^8
+  {0xee6b280000000000LLU, 0x0000000000000000LLU}, // 5^9
+  {0x9502f90000000000LLU, 0x0000000000000000LLU}, // 5^10
+  {0xba43b74000000000LLU, 0x0000000000000000LLU}, // 5^11
+  {0xe8d4a51000000000LLU, 0x0000000000000000LLU}, // 5^12
+  {0x9184e72a00000000LLU, 0x0000000000000000LLU}, // 5^13
+  {0xb5e620f480000000LLU, 0x0000000000000000LLU}, // 5^14
+  {0xe35fa931a0000000LLU, 0x0000000000000000LLU}, // 5^15
+  {0x8e1bc9bf04000000LLU, 0x0000000000000000LLU}, // 5^16
+  {0xb1a2bc2ec5000000LLU, 0x0000000000000000LLU}, // 5^17
+  {0xde0b6b3a76400000LLU, 0x0000000000000000LLU}, // 5^18
+  {0x8ac7230489e80000LLU, 0x0000000000000000LLU}, // 5^19
+  {0xad78ebc5ac620000LLU, 0x0000000000000000LLU}, // 5^20
+  {0xd8d726b7177a8000LLU, 0x0000000000000000LLU}, // 5^21
+  {0x878678326eac9000LLU, 0x0000000000000000LLU}, // 5^22
+  {0xa968163f0a57b400LLU, 0x0000000000000000LLU}, // 5^23
+  {0xd3c21bcecceda100LLU, 0x0000000000000000LLU}, // 5^24
+  {0x84595161401484a0LLU, 0x0000000000000000LLU}, // 5^25
+  {0xa56fa5b99019a5c8LLU, 0x0000000000000000LLU}, // 5^26
+  {0xcecb8f27f4200f3aLLU, 0x0000000000000000LLU}, // 5^27
+  {0x813f3978f8940984LLU, 0x4000000000000000LLU}, // 5^28
+  {0xa18f07d736b90be5LLU, 0x5000000000000000LLU}, // 5^29
+  {0xc9f2c9cd04674edeLLU, 0xa400000000000000LLU}, // 5^30
+  {0xfc6f7c4045812296LLU, 0x4d00000000000000LLU}, // 5^31
+  {0x9dc5ada82b70b59dLLU, 0xf020000000000000LLU}, // 5^32
+  {0xc5371912364ce305LLU, 0x6c28000000000000LLU}, // 5^33
+  {0xf684df56c3e01bc6LLU, 0xc732000000000000LLU}, // 5^34
+  {0x9a130b963a6c115cLLU, 0x3c7f400000000000LLU}, // 5^35
+  {0xc097ce7bc90715b3LLU, 0x4b9f100000000000LLU}, // 5^36
+  {0xf0bdc21abb48db20LLU, 0x1e86d40000000000LLU}, // 5^37
+  {0x96769950b50d88f4LLU, 0x1314448000000000LLU}, // 5^38
+  {0xbc143fa4e250eb31LLU, 0x17d955a000000000LLU}, // 5^39
+  {0xeb194f8e1ae525fdLLU, 0x5dcfab0800000000LLU}, // 5^40
+  {0x92efd1b8d0cf37beLLU, 0x5aa1cae500000000LLU}, // 5^41
+  {0xb7abc627050305adLLU, 0xf14a3d9e40000000LLU}, // 5^42
+  {0xe596b7b0c643c719LLU, 0x6d9ccd05d0000000LLU}, // 5^43
+  {0x8f7e32ce7bea5c6fLLU, 0xe4820023a2000000LLU}, // 5^44
+  {0xb35dbf821ae4f38bLLU, 0xdda2802c8a800000LLU}, // 5^45
+  {0xe0352f62a19e306eLLU, 0xd50b2037ad200000LLU}, // 5^46
+  {0x8c213d9da502de45LLU, 0x4526f422cc340000LLU}, // 5^47
+  {0xaf298d050e4395d6LLU, 0x9670b12b7f410000LLU}, // 5^48
+  {0xdaf3f04651d47b4cLLU, 0x3c0cdd765f114000LLU}, // 5^49
+  {0x88d8762bf324cd0fLLU, 0xa5880a69fb6ac800LLU}, // 5^50
+  {0xab0e93b6efee0053LLU, 0x8eea0d047a457a00LLU}, // 5^51
+  {0xd5d238a4abe98068LLU, 0x72a4904598d6d880LLU}, // 5^52
+  {0x85a36366eb71f041LLU, 0x47a6da2b7f864750LLU}, // 5^53
+  {0xa70c3c40a64e6c51LLU, 0x999090b65f67d924LLU}, // 5^54
+  {0xd0cf4b50cfe20765LLU, 0xfff4b4e3f741cf6dLLU}, // 5^55
+  {0x82818f1281ed449fLLU, 0xbff8f10e7a8921a4LLU}, // 5^56
+  {0xa321f2d7226895c7LLU, 0xaff72d52192b6a0dLLU}, // 5^57
+  {0xcbea6f8ceb02bb39LLU, 0x9bf4f8a69f764490LLU}, // 5^58
+  {0xfee50b7025c36a08LLU, 0x02f236d04753d5b4LLU}, // 5^59
+  {0x9f4f2726179a2245LLU, 0x01d762422c946590LLU}, // 5^60
+  {0xc722f0ef9d80aad6LLU, 0x424d3ad2b7b97ef5LLU}, // 5^61
+  {0xf8ebad2b84e0d58bLLU, 0xd2e0898765a7deb2LLU}, // 5^62
+  {0x9b934c3b330c8577LLU, 0x63cc55f49f88eb2fLLU}, // 5^63
+  {0xc2781f49ffcfa6d5LLU, 0x3cbf6b71c76b25fbLLU}, // 5^64
+};
+
+// Exact powers of 10 representable by f64
+static const f64 s_parse_f64_pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Eisel-Lemire: compute w * 10^q correctly rounded.
+// Returns false if result can't be decided or it is subnormal, zero or inf.
+static inline b32 parse_f64_eisel_lemire(u64 w, i32 q, u64 *out_bits) {
+  if (q < PARSE_F64_POW5_MIN || q > PARSE_F64_POW5_MAX || !w) {
+    return false;
+  }
+
+  i32 lz = __builtin_clzll(w);
+  w <<= lz;
+
+  const u64 *pow5 = s_parse_f64_pow5[q - PARSE_F64_POW5_MIN];
+  parse_f64_u128 p = (parse_f64_u128)w * pow5[0];
+  u64 hi = (u64)(p >> 64);
+  u64 lo = (u64)p;
+
+  // Lower bits of high product are all 1s: truncated 5^q matters,
+  // refine with low 64 bits of the power
+  if ((hi & 0x1FF) == 0x1FF) {
+    u64 hi2 = (u64)(((parse_f64_u128)w * pow5[1]) >> 64);
+    lo += hi2;
+    hi += lo < hi2;
+    if ((hi & 0x1FF) == 0x1FF && lo + 1 == 0) {
+      return false; // still ambiguous
+    }
+  }
+
+  u64 upper_bit = hi >> 63;
+  u64 mantissa = hi >> (upper_bit + 9);
+  // floor(log2(10^q)) + 63 - lz + upper_bit + f64 exponent bias
+  i32 exp2 = ((217706 * q) >> 16) + 63 - lz + (i32)upper_bit + 1023;
+  if (exp2 <= 0) {
+    return false; // subnormal
+  }
+
+  // Exactly halfway between two f64 (only possible for small q):
+  // round to even
+  if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+      && (mantissa << (upper_bit + 9)) == hi) {
+    mantissa &= ~1LLU;
+  }
+
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (2LLU << 52)) {
+    mantissa = 1LLU << 52;
+    ++exp2;
+  }
+  if (exp2 >= 0x7FF) {
+    return false; // inf
+  }
+
+  *out_bits = (mantissa & ~(1LLU << 52)) | (u64)exp2 << 52;
+  return true;
+}
+
+static inline u8 *parse_f64_strtod(u8 *p, f64 *out_d) {
+  u8 *end;
+  f64 d = strtod((char *)p, (char **)&end);
+  if (end != p) {
+    *out_d = d;
+  }
+  return end;
+}
+
+// Parse `[-]digits[.digits]` at `p` into `out_d`.
+// Returns pointer past the number or `p` if there is no number at `p`.
+static inline u8 *parse_f64(u8 *p, f64 *out_d) {
+  u8 *cur = p;
+  b32 is_neg = *cur == '-';
+  cur += is_neg;
+
+  // Keep up to 19 significant digits in `w`, they always fit into u64.
+  // Value is w * 10^exp10, `is_truncated` if any dropped digit is non-zero.
+  u64 w = 0;
+  i32 digit_count = 0;
+  i32 exp10 = 0;
+  b32 is_truncated = 0;
+
+  u8 *int_begin = cur;
+  for (u32 d; (d = (u32)*cur - '0') < 10; ++cur) {
+    if (digit_count < 19) {
+      w = w * 10 + d;
+      digit_count += w != 0;
+    } else {
+      ++exp10;
+      is_truncated |= d != 0;
+    }
+  }
+  u8 *int_end = cur;
+
+  u8 *frac_begin = cur;
+  if (*cur == '.') {
+    frac_begin = ++cur;
+    for (u32 d; (d = (u32)*cur - '0') < 10; ++cur) {
+      if (digit_count < 19) {
+        w = w * 10 + d;
+        digit_count += w != 0;
+        --exp10;
+      } else {
+        is_truncated |= d != 0;
+      }
+    }
+  }
+
+  // Not the format we handle: `.5`, `1.`, `1e5`, `inf`, `+1` etc
+  if (UNLIKELY(int_begin == int_end || frac_begin == cur
+      || (*cur | 0x20) == 'e')) {
+    return parse_f64_strtod(p, out_d);
+  }
+
+  f64 d;
+  if (!w) {
+    d = 0.0;
+  } else if (!is_truncated && w <= (1LLU << 53)
+      && exp10 >= -22 && exp10 <= 22) {
+    // Clinger fast path
+    d = (f64)w;
+    d = exp10 < 0
+      ? d / s_parse_f64_pow10[-exp10]
+      : d * s_parse_f64_pow10[exp10];
+  } else {
+    // Truncated digits: w <= value < w + 1, result is exact only if both
+    // bounds round to the same f64
+    u64 bits;
+    u64 bits_up;
+    if (!parse_f64_eisel_lemire(w, exp10, &bits)
+        || (is_truncated
+          && (!parse_f64_eisel_lemire(w + 1, exp10, &bits_up)
+            || bits != bits_up))) {
+      return parse_f64_strtod(p, out_d);
+    }
+    __builtin_memcpy(&d, &bits, sizeof(d));
+  }
+
+  *out_d = is_neg ? -d : d;
+  return cur;
+}
@@ -0,0 +1,209 @@
+// Performance-Aware-Programming Course
+// https://www.computerenhance.com/p/table-of-contents
+//
+// Part 3
+// Compare parse_f64() against strtod()
+
+#include <stdio.h>      // fprintf snprintf stderr
+#include <stdlib.h>     // malloc free atol rand srand strtod
+#include <string.h>     // memcmp strcmp
+
+#include "types.h"
+#include "os.h"
+#include "parse_f64.h"
+#include "tester.h"
+
+// Begin unity build
+#include "os.c"
+#include "timer.c"
+#include "tester.c"
+// End unity build
+
+enum {
+  NUMBER_COUNT_DEFAULT  = 1000000,
+  NUMBER_SIZE_MAX       = 32,   // "-180.00000000000000000, " fits
+};
+
+struct buf_u8 {
+  u8 *data;
+  u64 size;
+};
+
+static f64 rand_range(f64 min, f64 max) {
+  u32 x = rand();
+  f64 t = (f64)x / RAND_MAX;
+  return (1.0 - t) * min + t * max;
+}
+
+// Numbers in gen_harvestine format separated by ", "
+static u64 gen_numbers(struct buf_u8 buf, u64 number_count) {
+  u64 size = 0;
+  for (u64 i = 0; i < number_count; ++i) {
+    size += snprintf((char *)buf.data + size, buf.size - size, "%.17f, ",
+        rand_range(-180.0, 180.0));
+  }
+  return size;
+}
+
+// --------------------------------------
+// Tests
+// --------------------------------------
+typedef u8 *parse_func_t(u8 *p, f64 *out_d);
+
+static u8 *parse_strtod(u8 *p, f64 *out_d) {
+  u8 *end;
+  *out_d = strtod((char *)p, (char **)&end);
+  return end;
+}
+
+struct test {
+  const char *name;
+  parse_func_t *func;
+};
+
+static struct test s_tests[] = {
+  {"strtod", parse_strtod},
+  {"parse_f64", parse_f64},
+};
+
+// Returns number count or 0 on error
+static u64 parse_all(parse_func_t *parse, struct buf_u8 buf, f64 *out) {
+  u8 *cur = buf.data;
+  u8 *end = buf.data + buf.size;
+  u64 count = 0;
+  while (cur < end) {
+    u8 *next = parse(cur, out + count++);
+    if (next == cur || next + 2 > end) {
+      return 0;
+    }
+    cur = next + 2; // ", "
+  }
+  return count;
+}
+
+// Both parsers should consume the same amount of characters and return the
+// same bits
+static b32 verify(struct buf_u8 buf, u64 *out_mismatch_count) {
+  u8 *cur = buf.data;
+  u8 *end = buf.data + buf.size;
+  u64 mismatch_count = 0;
+  while (cur < end) {
+    f64 expected;
+    f64 actual;
+    u8 *expected_end = parse_strtod(cur, &expected);
+    u8 *actual_end = parse_f64(cur, &actual);
+    if (expected_end != actual_end
+        || memcmp(&expected, &actual, sizeof(f64)) != 0) {
+      if (mismatch_count++ < 10) {
+        fprintf(stderr, "Mismatch: '%.*s' strtod: %.17g parse_f64: %.17g\n",
+            (int)(expected_end - cur), cur, expected, actual);
+      }
+    }
+    cur = expected_end + 2;
+  }
+  *out_mismatch_count = mismatch_count;
+  return mismatch_count == 0;
+}
+
+// --------------------------------------
+// Main
+// --------------------------------------
+static void print_usage(void) {
+  fprintf(stderr, "Usage:\n    parse_f64_bench [number_count]\n");
+}
+
+int main(int argc, char **argv) {
+  g_os_validator = (struct os_validator){
+    .log_error = puts,
+    .trap_on_error = 0,
+  };
+
+  if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+    print_usage();
+    return 0;
+  }
+
+  i64 number_count = argc > 1 ? atol(argv[1]) : NUMBER_COUNT_DEFAULT;
+  if (number_count <= 0) {
+    fprintf(stderr, "Error: number_count should be > 0.\n");
+    print_usage();
+    return 1;
+  }
+
+  int ret = 1;
+
+  // +1 for snprintf '\0'
+  struct buf_u8 buf = {
+    .data = malloc(number_count * NUMBER_SIZE_MAX + 1),
+    .size = number_count * NUMBER_SIZE_MAX + 1,
+  };
+  f64 *out = malloc(number_count * sizeof(f64));
+  if (!buf.data || !out) {
+    fprintf(stderr, "Error: failed to allocate memory\n");
+    goto cleanup;
+  }
+
+  srand(0);
+  buf.size = gen_numbers(buf, number_count);
+
+  u64 mismatch_count;
+  if (!verify(buf, &mismatch_count)) {
+    fprintf(stderr, "Error: %llu of %lld numbers mismatch strtod()\n",
+        mismatch_count, number_count);
+    goto cleanup;
+  }
+  fprintf(stderr, "Verified: %lld numbers match strtod()\n\n", number_count);
+
+  u64 cpu_timer_freq = get_or_estimate_cpu_timer_freq(300);
+  u64 try_duration_tsc = 10 * cpu_timer_freq; // 10 seconds
+
+  struct tester testers[ARRAY_COUNT(s_tests)] = {0};
+  for (u64 i = 0; i < ARRAY_COUNT(testers); ++i) {
+    struct tester *tester = testers + i;
+    tester->try_duration_tsc = try_duration_tsc;
+    tester->expected_bytes   = buf.size;
+  }
+
+  // Run tests
+  u64 number_of_runs = (u64)-1; // run tests forever
+  for (u64 run_index = 0; run_index < number_of_runs; ++run_index) {
+    fprintf(stderr, "------------------------------------------------------\n");
+    fprintf(stderr, "RUN %-20llu\n", run_index);
+    fprintf(stderr, "------------------------------------------------------\n");
+
+    for (u64 test_index = 0; test_index < ARRAY_COUNT(s_tests); ++test_index) {
+      struct test *test = s_tests + test_index;
+      struct tester *tester = testers + test_index;
+
+      fprintf(stderr, "--- Test %s ---\n", test->name);
+      tester->run = (struct tester_run){0};
+      while (tester_step(tester)) {
+        tester_zone_begin(tester);
+        u64 count = parse_all(test->func, buf, out);
+        tester_zone_end(tester);
+
+        tester_count_bytes(tester, buf.size);
+
+        if (count != (u64)number_count) {
+          tester_error(tester, "Error: failed to parse numbers");
+        }
+      }
+
+      tester_print(tester, cpu_timer_freq);
+      fprintf(stderr, "\n");
+
+      if (tester->run.state == TESTER_STATE_ERROR) {
+        goto cleanup; // break outside of multiple loops
+      }
+    }
+  }
+
+  ret = 0;
+
+cleanup:
+  free(out);
+  free(buf.data);
+  buf = (struct buf_u8){0};
+
+  return ret;
+}
@@ -3,8 +3,13 @@
 
 #include "timer.h" // read_cpu_timer()
 
-#include <assert.h>   // assert
-#include <stdio.h>    // fprintf stderr
+#include <assert.h>     // assert
+#include <stdatomic.h>  // atomic_load_explicit atomic_store_explicit
+                        // atomic_compare_exchange_strong atomic_fetch_add
+                        // atomic_fetch_or
+#include <stdio.h>      // fprintf stderr fopen fclose
+#include <stdlib.h>     // malloc free
+#include <string.h>     // strcmp memset
 
 static const char * const s_delim =
   "--------------------------------------------------"
@@ -16,54 +21,343 @@ struct profiler_zone {
   u64 self_tsc;   // excludes elapsed children
   u64 total_tsc;  // includes elapsed children
   u64 bytes;      // procossed bytes
+  u64 pmc[OS_PMC_COUNT];  // hardware counters, include children
 };
 
-static struct profiler_zone s_zones[PROFILER_ZONES_SIZE_MAX];
-static struct profiler_zone_mark s_total_mark;
-static u32 s_last_zone_index;
+// Call tree node, a zone on a particular path from the thread root
+struct profiler_node {
+  const char *name;
+  u32 index;            // zone index
+  u32 parent;
+  u32 first_child;
+  u32 last_child;
+  u32 next_sibling;
+  u32 hint_child;       // child found last time, loops call the same one
+  u64 hit_count;
+  u64 self_tsc;         // excludes elapsed children
+  u64 total_tsc;        // includes elapsed children
+};
+
+enum profiler_thread_state {
+  PROFILER_THREAD_STATE_UNUSED = 0,
+  PROFILER_THREAD_STATE_RUNNING,
+  PROFILER_THREAD_STATE_RELEASED,   // can be reused by thread with same name
+};
+
+enum {
+  PROFILER_TRACE_INDEX_BITS = 16,
+};
+static_assert(PROFILER_ZONES_SIZE_MAX <= 1 << PROFILER_TRACE_INDEX_BITS,
+    "Zone index doesn't fit into trace event");
+
+// Finished zone. Elapsed tsc has 48 bits, that's 39 hours at 2 GHz.
+struct profiler_trace_event {
+  u64 begin_tsc;
+  u64 elapsed_tsc_index;            // elapsed tsc << 16 | zone index
+};
+
+// Zone table of a thread. Zone index 1 is the root zone of the thread.
+struct profiler_thread {
+  _Atomic u32 state;                // enum profiler_thread_state
+  const char *name;
+  u32 last_zone_index;
+  struct profiler_zone_mark root_mark;
+
+  struct profiler_trace_event *trace_events;  // 0 - trace mode is off
+  u64 trace_event_count;            // ever recorded, ring index is masked
+  u64 trace_event_mask;             // ring buffer size - 1
+
+  struct os_pmc_group pmc_group;    // count is 0 - counters are off
+
+  u32 current_node;
+  u32 node_count;
+  u64 not_tracked_node_count;       // zones begun when nodes were full
+
+  struct profiler_zone zones[PROFILER_ZONES_SIZE_MAX];
+  struct profiler_node nodes[PROFILER_NODES_SIZE_MAX];
+};
+
+// Tables are only written by their threads, there is no synchronization on
+// the zone begin/end path. Untouched tables stay in not committed .bss pages.
+static struct profiler_thread s_threads[PROFILER_THREADS_SIZE_MAX];
+static struct profiler_thread *s_main_thread;
+static _Atomic u32 s_not_profiled_thread_count;
+static u64 s_trace_event_mask;      // 0 - trace mode is off
+static u64 s_trace_begin_tsc;
+static u32 s_pmc_kind_mask;         // 0 - hardware counters are off
+static _Atomic u32 s_pmc_opened_mask;
+static _Atomic u32 s_pmc_not_counted_thread_count;
+
+u32 g_profiler_level_mask = PROFILER_LEVEL_MASK_DEFAULT;
+
+// Table of the calling thread, 0 if the thread is not profiled
+static _Thread_local struct profiler_thread *s_thread;
+
+// Merged tables for printing, too large for the stack
+static struct profiler_zone s_merged_zones[PROFILER_ZONES_SIZE_MAX];
+static struct profiler_zone s_merged_roots[PROFILER_THREADS_SIZE_MAX];
+static struct profiler_node s_merged_nodes[PROFILER_NODES_SIZE_MAX];
+static u32 s_merged_node_count;
+// Thread to merged node index, PROFILER_NODES_SIZE_MAX - dropped
+static u32 s_merged_node_map[PROFILER_NODES_SIZE_MAX];
+
+static struct profiler_thread *profiler_thread_claim(const char *name) {
+  // Prefer table of a finished thread with the same name, so threads that
+  // are started over and over don't run out of tables
+  for (u32 i = 0; i < PROFILER_THREADS_SIZE_MAX; ++i) {
+    struct profiler_thread *t = s_threads + i;
+    u32 expected = PROFILER_THREAD_STATE_RELEASED;
+    if (atomic_load_explicit(&t->state, memory_order_acquire) == expected
+        && strcmp(t->name, name) == 0
+        && atomic_compare_exchange_strong(&t->state, &expected,
+          PROFILER_THREAD_STATE_RUNNING)) {
+      return t;
+    }
+  }
+
+  for (u32 i = 0; i < PROFILER_THREADS_SIZE_MAX; ++i) {
+    struct profiler_thread *t = s_threads + i;
+    u32 expected = PROFILER_THREAD_STATE_UNUSED;
+    if (atomic_compare_exchange_strong(&t->state, &expected,
+          PROFILER_THREAD_STATE_RUNNING)) {
+      t->name = name;
+      return t;
+    }
+  }
+
+  atomic_fetch_add(&s_not_profiled_thread_count, 1);
+  return 0;
+}
+
+void profiler_thread_begin(const char *name) {
+  if (!g_profiler_level_mask) {
+    return;
+  }
+
+  struct profiler_thread *t = profiler_thread_claim(name);
+  if (t && s_trace_event_mask && !t->trace_events) {
+    u64 size = (s_trace_event_mask + 1) * sizeof(*t->trace_events);
+    t->trace_events = malloc(size);
+    t->trace_event_mask = t->trace_events ? s_trace_event_mask : 0;
+    if (!t->trace_events) {
+      fprintf(stderr, "Warning: failed to allocate %llu bytes of trace "
+          "events, thread '%s' is not traced\n", size, name);
+    }
+  }
+
+  if (t && s_pmc_kind_mask) {
+    if (os_pmc_open(&t->pmc_group, s_pmc_kind_mask)) {
+      u32 opened_mask = 0;
+      for (u32 i = 0; i < t->pmc_group.count; ++i) {
+        opened_mask |= 1 << t->pmc_group.kinds[i];
+      }
+      atomic_fetch_or(&s_pmc_opened_mask, opened_mask);
+    } else {
+      atomic_fetch_add(&s_pmc_not_counted_thread_count, 1);
+    }
+  }
+
+  s_thread = t;
+  if (t) {
+    t->current_node = 0;
+    t->node_count = MAX(t->node_count, 1u);
+    t->root_mark = profiler_zone_begin(1, name, 0);
+  }
+}
+
+void profiler_thread_end(void) {
+  struct profiler_thread *t = s_thread;
+  if (!t) {
+    return;
+  }
+  profiler_zone_end(&t->root_mark);
+  os_pmc_close(&t->pmc_group);
+  s_thread = 0;
+  atomic_store_explicit(&t->state, PROFILER_THREAD_STATE_RELEASED,
+      memory_order_release);
+}
+
+void profiler_enable(u32 level_mask) {
+  g_profiler_level_mask = level_mask;
+}
 
 void profiler_begin(void) {
-  s_total_mark = profiler_zone_begin(1, "Main", 0);
+  profiler_thread_begin("Main");
+  s_main_thread = s_thread;
 }
 
 void profiler_end(void) {
-  profiler_zone_end(&s_total_mark);
+  if (s_thread) {
+    profiler_zone_end(&s_thread->root_mark);
+    os_pmc_close(&s_thread->pmc_group);
+  }
+}
+
+void profiler_pmc_begin(u32 kind_mask) {
+  s_pmc_kind_mask = kind_mask & ((1 << OS_PMC_COUNT) - 1);
+}
+
+// Returns child node of `parent` for zone `index`, adds one if there is none.
+// Returns 0 if nodes are full.
+static u32 profiler_node_child(struct profiler_thread *t, u32 parent,
+    u32 index, const char *name) {
+  struct profiler_node *p = t->nodes + parent;
+  if (p->hint_child && t->nodes[p->hint_child].index == index) {
+    return p->hint_child;
+  }
+
+  for (u32 c = p->first_child; c; c = t->nodes[c].next_sibling) {
+    if (t->nodes[c].index == index) {
+      p->hint_child = c;
+      return c;
+    }
+  }
+
+  if (UNLIKELY(t->node_count == PROFILER_NODES_SIZE_MAX)) {
+    ++t->not_tracked_node_count;
+    return 0;
+  }
+
+  u32 c = t->node_count++;
+  t->nodes[c].name    = name;
+  t->nodes[c].index   = index;
+  t->nodes[c].parent  = parent;
+  if (p->last_child) {
+    t->nodes[p->last_child].next_sibling = c;
+  } else {
+    p->first_child = c;
+  }
+  p->last_child = c;
+  p->hint_child = c;
+  return c;
 }
 
 struct profiler_zone_mark profiler_zone_begin(u32 index,
     const char *name, u64 bytes) {
   assert(index < PROFILER_ZONES_SIZE_MAX && "Zone index out of bounds");
 
-  u64 prev_total_tsc = s_zones[index].total_tsc;
+  struct profiler_thread *t = s_thread;
+  if (!t) {
+    return (struct profiler_zone_mark){0};
+  }
+
+  struct profiler_zone_mark mark;
+  mark.name           = name;
+  mark.prev_total_tsc = t->zones[index].total_tsc;
+  mark.index          = index;
+  mark.parent_index   = t->last_zone_index;
+  mark.bytes          = bytes;
+
+  // Not tracked zone leaves current node, its children go to the parent
+  mark.node_index = profiler_node_child(t, t->current_node, index, name);
+  if (mark.node_index) {
+    t->current_node = mark.node_index;
+  }
+
+  // Counters first, so they don't count read_cpu_timer()
+  if (t->pmc_group.count) {
+    u64 pmc[OS_PMC_COUNT];
+    os_pmc_read(&t->pmc_group, pmc);
+    for (u32 i = 0; i < t->pmc_group.count; ++i) {
+      mark.pmc_base[i] = pmc[i] - t->zones[index].pmc[t->pmc_group.kinds[i]];
+    }
+  }
 
-  struct profiler_zone_mark mark = {
-    name,
-    read_cpu_timer(),
-    prev_total_tsc,
-    index,
-    s_last_zone_index,
-    bytes,
-  };
+  mark.begin_tsc = read_cpu_timer();
 
-  s_last_zone_index = index;
+  t->last_zone_index = index;
   return mark;
 }
 
 void profiler_zone_end(struct profiler_zone_mark *mark) {
   assert(mark->index < PROFILER_ZONES_SIZE_MAX && "Zone index out of bounds");
+
+  struct profiler_thread *t = s_thread;
+  if (!mark->index || !t) {
+    return; // zone began on a not profiled thread
+  }
   assert(mark->begin_tsc != 0 && "Ending zone, that has not began");
 
   u64 elapsed_tsc = read_cpu_timer() - mark->begin_tsc;
 
-  s_zones[mark->index].name           = mark->name;
-  s_zones[mark->index].hit_count      += 1;
-  s_zones[mark->index].self_tsc       += elapsed_tsc;
-  s_zones[mark->index].total_tsc      = mark->prev_total_tsc + elapsed_tsc;
-  s_zones[mark->index].bytes          += mark->bytes;
+  // Totals like total_tsc, recursive zone keeps the outermost
+  if (t->pmc_group.count) {
+    u64 pmc[OS_PMC_COUNT];
+    os_pmc_read(&t->pmc_group, pmc);
+    for (u32 i = 0; i < t->pmc_group.count; ++i) {
+      t->zones[mark->index].pmc[t->pmc_group.kinds[i]] =
+        pmc[i] - mark->pmc_base[i];
+    }
+  }
 
-  s_zones[mark->parent_index].self_tsc -= elapsed_tsc;
+  t->zones[mark->index].name          = mark->name;
+  t->zones[mark->index].hit_count     += 1;
+  t->zones[mark->index].self_tsc      += elapsed_tsc;
+  t->zones[mark->index].total_tsc     = mark->prev_total_tsc + elapsed_tsc;
+  t->zones[mark->index].bytes         += mark->bytes;
 
-  s_last_zone_index = mark->parent_index;
+  t->zones[mark->parent_index].self_tsc -= elapsed_tsc;
+
+  t->last_zone_index = mark->parent_index;
+
+  if (mark->node_index) {
+    struct profiler_node *node = t->nodes + mark->node_index;
+    node->hit_count   += 1;
+    node->self_tsc    += elapsed_tsc;
+    node->total_tsc   += elapsed_tsc;
+    t->nodes[node->parent].self_tsc -= elapsed_tsc;
+    t->current_node = node->parent;
+  }
+
+  if (t->trace_events) {
+    struct profiler_trace_event *e =
+      t->trace_events + (t->trace_event_count++ & t->trace_event_mask);
+    e->begin_tsc = mark->begin_tsc;
+    e->elapsed_tsc_index =
+      elapsed_tsc << PROFILER_TRACE_INDEX_BITS | mark->index;
+  }
+}
+
+static void profiler_zone_merge(struct profiler_zone *dst,
+    const struct profiler_zone *src) {
+  dst->name       = src->name;
+  dst->hit_count  += src->hit_count;
+  dst->self_tsc   += src->self_tsc;
+  dst->total_tsc  += src->total_tsc;
+  dst->bytes      += src->bytes;
+  for (u32 i = 0; i < OS_PMC_COUNT; ++i) {
+    dst->pmc[i]   += src->pmc[i];
+  }
+}
+
+// Merge into zone with the same name or the first empty one of `zones`
+static void profiler_zone_merge_named(struct profiler_zone *zones, u32 count,
+    const struct profiler_zone *src) {
+  for (u32 i = 0; i < count; ++i) {
+    if (!zones[i].name || strcmp(zones[i].name, src->name) == 0) {
+      profiler_zone_merge(zones + i, src);
+      return;
+    }
+  }
+}
+
+// Hardware counter columns, printed if both counters were opened
+static const struct {
+  const char *title;
+  u32 numerator;        // enum os_pmc
+  u32 denominator;      // enum os_pmc
+  f32 scale;
+} s_pmc_ratios[] = {
+  {"IPC",     OS_PMC_INSTRUCTIONS,    OS_PMC_CYCLES,        1.0f},
+  {"L1D/1k",  OS_PMC_L1D_MISSES,      OS_PMC_INSTRUCTIONS,  1000.0f},
+  {"LLC/1k",  OS_PMC_LLC_MISSES,      OS_PMC_INSTRUCTIONS,  1000.0f},
+  {"BrM/1k",  OS_PMC_BRANCH_MISSES,   OS_PMC_INSTRUCTIONS,  1000.0f},
+  {"Stall%",  OS_PMC_STALLED_CYCLES,  OS_PMC_CYCLES,        100.0f},
+};
+
+static b32 profiler_pmc_ratio_is_opened(u32 opened_mask, u32 i) {
+  return (opened_mask & 1 << s_pmc_ratios[i].numerator)
+    && (opened_mask & 1 << s_pmc_ratios[i].denominator);
 }
 
 static void profiler_print_titles(b32 csv) {
@@ -76,6 +370,20 @@ static void profiler_print_titles(b32 csv) {
   fprintf(stderr, csv ? ",%s"   : "|%6s",    "Self %");
   fprintf(stderr, csv ? ",%s"   : "|%7s",    "Data MB");
   fprintf(stderr, csv ? ",%s"   : "|%5s",    "GB/s");
+
+  u32 opened_mask = atomic_load_explicit(&s_pmc_opened_mask,
+      memory_order_relaxed);
+  for (u32 i = 0; i < ARRAY_COUNT(s_pmc_ratios); ++i) {
+    if (profiler_pmc_ratio_is_opened(opened_mask, i)) {
+      fprintf(stderr, csv ? ",%s" : "|%7s", s_pmc_ratios[i].title);
+    }
+  }
+  // Raw counts only fit into csv
+  for (u32 kind = 0; csv && kind < OS_PMC_COUNT; ++kind) {
+    if (opened_mask & 1 << kind) {
+      fprintf(stderr, ",%s", os_pmc_name(kind));
+    }
+  }
   fprintf(stderr, "\n");
 }
 
@@ -99,11 +407,44 @@ static void profiler_print_zone(struct profiler_zone *pf, u64 total_tsc,
   fprintf(stderr, csv ? ",%f"   : "|%6.2f",  self_percent);
   fprintf(stderr, csv ? ",%f"   : "|%7.2f",  mb);
   fprintf(stderr, csv ? ",%f"   : "|%5.2f",  gb_p_sec);
+
+  // Zones of threads without counters have zero denominator
+  u32 opened_mask = atomic_load_explicit(&s_pmc_opened_mask,
+      memory_order_relaxed);
+  for (u32 i = 0; i < ARRAY_COUNT(s_pmc_ratios); ++i) {
+    if (!profiler_pmc_ratio_is_opened(opened_mask, i)) {
+      continue;
+    }
+    u64 denominator = pf->pmc[s_pmc_ratios[i].denominator];
+    if (denominator) {
+      f32 ratio = (f32)pf->pmc[s_pmc_ratios[i].numerator] / denominator
+        * s_pmc_ratios[i].scale;
+      fprintf(stderr, csv ? ",%f" : "|%7.2f", ratio);
+    } else {
+      fprintf(stderr, csv ? "," : "|%7s", "-");
+    }
+  }
+  for (u32 kind = 0; csv && kind < OS_PMC_COUNT; ++kind) {
+    if (opened_mask & 1 << kind) {
+      fprintf(stderr, ",%llu", pf->pmc[kind]);
+    }
+  }
   fprintf(stderr, "\n");
 }
 
-void profiler_print_stats(u64 cpu_timer_freq, b32 csv) {
-  u64 total_tsc = s_zones[1].total_tsc;
+static void profiler_print_zones(struct profiler_zone *zones, u32 count,
+    u64 total_tsc, u64 cpu_timer_freq, b32 csv) {
+  for (u32 i = 0; i < count; ++i) {
+    if (zones[i].name) {
+      profiler_print_zone(zones + i, total_tsc, cpu_timer_freq, csv);
+    }
+  }
+}
+
+// Returns main zone total tsc
+static u64 profiler_print_header(u64 cpu_timer_freq, b32 csv,
+    void (*print_titles)(b32 csv)) {
+  u64 total_tsc = s_main_thread ? s_main_thread->zones[1].total_tsc : 0;
   f32 total_sec = (f32)total_tsc / cpu_timer_freq;
 
   if (!csv) {
@@ -123,18 +464,105 @@ void profiler_print_stats(u64 cpu_timer_freq, b32 csv) {
     } else {
       fprintf(stderr, "??? [!] profiler_begin() / profiler_end() not called\n");
     }
+
+    u32 not_profiled_count = atomic_load_explicit(&s_not_profiled_thread_count,
+        memory_order_relaxed);
+    if (not_profiled_count) {
+      fprintf(stderr, "%-24s%u [!] PROFILER_THREADS_SIZE_MAX is %d\n",
+          "Threads not profiled: ", not_profiled_count,
+          PROFILER_THREADS_SIZE_MAX);
+    }
+
+    if (s_pmc_kind_mask) {
+      u32 opened_mask = atomic_load_explicit(&s_pmc_opened_mask,
+          memory_order_relaxed);
+      fprintf(stderr, "%-24s", "Hardware counters: ");
+      for (u32 kind = 0; kind < OS_PMC_COUNT; ++kind) {
+        if (s_pmc_kind_mask & 1 << kind) {
+          fprintf(stderr, "%s%s ", os_pmc_name(kind),
+              opened_mask & 1 << kind ? "" : "(n/a)");
+        }
+      }
+      fprintf(stderr, "\n");
+
+      u32 not_counted_count = atomic_load_explicit(
+          &s_pmc_not_counted_thread_count, memory_order_relaxed);
+      if (not_counted_count) {
+        fprintf(stderr, "%-24s%u [!] perf_event_open() failed, no PMU or "
+            "see /proc/sys/kernel/perf_event_paranoid\n",
+            "Threads not counted: ", not_counted_count);
+      }
+    }
     fprintf(stderr, "\n");
     fprintf(stderr, "%s\n", s_delim);
   }
 
-  profiler_print_titles(csv);
+  print_titles(csv);
   if (!csv) {
     fprintf(stderr, "%s\n", s_delim);
   }
+  return total_tsc;
+}
+
+void profiler_print_stats(u64 cpu_timer_freq, b32 csv) {
+  if (!g_profiler_level_mask) {
+    return;
+  }
+
+  memset(s_merged_zones, 0, sizeof(s_merged_zones));
+  memset(s_merged_roots, 0, sizeof(s_merged_roots));
+
+  for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+    struct profiler_thread *thread = s_threads + t;
+    if (atomic_load_explicit(&thread->state, memory_order_acquire)
+        == PROFILER_THREAD_STATE_UNUSED) {
+      continue;
+    }
+
+    if (thread->zones[1].name) {
+      profiler_zone_merge_named(s_merged_roots, PROFILER_THREADS_SIZE_MAX,
+          &thread->zones[1]);
+    }
+    for (u32 i = 2; i < PROFILER_ZONES_SIZE_MAX; ++i) {
+      if (thread->zones[i].name) {
+        profiler_zone_merge(&s_merged_zones[i], &thread->zones[i]);
+      }
+    }
+  }
+
+  u64 total_tsc = profiler_print_header(cpu_timer_freq, csv,
+      profiler_print_titles);
+  profiler_print_zones(s_merged_roots, PROFILER_THREADS_SIZE_MAX, total_tsc,
+      cpu_timer_freq, csv);
+  profiler_print_zones(s_merged_zones, PROFILER_ZONES_SIZE_MAX, total_tsc,
+      cpu_timer_freq, csv);
+
+  if (!csv) {
+    fprintf(stderr, "%s\n\n", s_delim);
+  }
+}
+
+void profiler_print_thread_stats(u64 cpu_timer_freq, b32 csv) {
+  if (!g_profiler_level_mask) {
+    return;
+  }
+
+  u64 total_tsc = profiler_print_header(cpu_timer_freq, csv,
+      profiler_print_titles);
+
+  for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+    struct profiler_thread *thread = s_threads + t;
+    if (atomic_load_explicit(&thread->state, memory_order_acquire)
+        == PROFILER_THREAD_STATE_UNUSED) {
+      continue;
+    }
 
-  for (u64 i = 1; i < PROFILER_ZONES_SIZE_MAX; ++i) {
-    if (s_zones[i].name) {
-      profiler_print_zone(&s_zones[i], total_tsc, cpu_timer_freq, csv);
+    fprintf(stderr, csv ? "thread,%u,%s\n" : "Thread %u: %s\n",
+        t, thread->name);
+    profiler_print_zones(thread->zones, PROFILER_ZONES_SIZE_MAX, total_tsc,
+        cpu_timer_freq, csv);
+    if (!csv) {
+      fprintf(stderr, "\n");
     }
   }
 
@@ -142,6 +570,254 @@ void profiler_print_stats(u64 cpu_timer_freq, b32 csv) {
     fprintf(stderr, "%s\n\n", s_delim);
   }
 }
+// Merge call trees of all threads into s_merged_nodes.
+// Parents are added before children, so a single pass over nodes works.
+static void profiler_merge_nodes(void) {
+  memset(s_merged_nodes, 0, sizeof(s_merged_nodes));
+  s_merged_node_count = 1;
+
+  for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+    struct profiler_thread *thread = s_threads + t;
+    if (atomic_load_explicit(&thread->state, memory_order_acquire)
+        == PROFILER_THREAD_STATE_UNUSED) {
+      continue;
+    }
+
+    s_merged_node_map[0] = 0;
+    for (u32 i = 1; i < thread->node_count; ++i) {
+      const struct profiler_node *src = thread->nodes + i;
+      u32 parent = s_merged_node_map[src->parent];
+      if (parent == PROFILER_NODES_SIZE_MAX) {
+        s_merged_node_map[i] = PROFILER_NODES_SIZE_MAX;
+        continue;
+      }
+
+      u32 m = s_merged_nodes[parent].first_child;
+      while (m && strcmp(s_merged_nodes[m].name, src->name) != 0) {
+        m = s_merged_nodes[m].next_sibling;
+      }
+      if (!m) {
+        if (s_merged_node_count == PROFILER_NODES_SIZE_MAX) {
+          s_merged_node_map[i] = PROFILER_NODES_SIZE_MAX;
+          continue;
+        }
+        m = s_merged_node_count++;
+        struct profiler_node *p = s_merged_nodes + parent;
+        s_merged_nodes[m].name    = src->name;
+        s_merged_nodes[m].index   = src->index;
+        s_merged_nodes[m].parent  = parent;
+        if (p->last_child) {
+          s_merged_nodes[p->last_child].next_sibling = m;
+        } else {
+          p->first_child = m;
+        }
+        p->last_child = m;
+      }
+
+      s_merged_node_map[i] = m;
+      s_merged_nodes[m].hit_count += src->hit_count;
+      s_merged_nodes[m].self_tsc  += src->self_tsc;
+      s_merged_nodes[m].total_tsc += src->total_tsc;
+    }
+  }
+}
+
+// `root;child;grandchild` path of merged node
+static void profiler_write_node_path(FILE *f, u32 node) {
+  u32 parent = s_merged_nodes[node].parent;
+  if (parent) {
+    profiler_write_node_path(f, parent);
+    fputc(';', f);
+  }
+  fputs(s_merged_nodes[node].name, f);
+}
+
+static void profiler_print_tree_titles(b32 csv) {
+  fprintf(stderr, csv ?  "%s"   :  "%-48s",  "Path");
+  fprintf(stderr, csv ? ",%s"   : "|%9s",    "Hits #");
+  fprintf(stderr, csv ? ",%s"   : "|%9s",    "Total s");
+  fprintf(stderr, csv ? ",%s"   : "|%6s",    "Total%");
+  fprintf(stderr, csv ? ",%s"   : "|%9s",    "Self s");
+  fprintf(stderr, csv ? ",%s"   : "|%6s",    "Self %");
+  fprintf(stderr, "\n");
+}
+
+static void profiler_print_tree_node(u32 node, u32 depth, u64 total_tsc,
+    u64 cpu_timer_freq, b32 csv) {
+  struct profiler_node *n = s_merged_nodes + node;
+
+  f32 total_percent = (f32)n->total_tsc  / total_tsc * 100.0f;
+  f32 self_percent  = (f32)n->self_tsc   / total_tsc * 100.0f;
+  f32 total_sec     = (f32)n->total_tsc  / cpu_timer_freq;
+  f32 self_sec      = (f32)n->self_tsc   / cpu_timer_freq;
+
+  if (csv) {
+    profiler_write_node_path(stderr, node);
+  } else {
+    // Name is cut to fit the column, indentation stops at depth 20
+    int indent = (int)MIN(depth * 2, 40u);
+    fprintf(stderr, "%*s%-*.*s", indent, "", 48 - indent, 48 - indent,
+        n->name);
+  }
+  fprintf(stderr, csv ? ",%llu" : "|%9llu",   n->hit_count);
+  fprintf(stderr, csv ? ",%f"   : "|%9.5f",  total_sec);
+  fprintf(stderr, csv ? ",%f"   : "|%6.2f",  total_percent);
+  fprintf(stderr, csv ? ",%f"   : "|%9.5f",  self_sec);
+  fprintf(stderr, csv ? ",%f"   : "|%6.2f",  self_percent);
+  fprintf(stderr, "\n");
+
+  for (u32 c = n->first_child; c; c = s_merged_nodes[c].next_sibling) {
+    profiler_print_tree_node(c, depth + 1, total_tsc, cpu_timer_freq, csv);
+  }
+}
+
+void profiler_print_tree(u64 cpu_timer_freq, b32 csv) {
+  if (!g_profiler_level_mask) {
+    return;
+  }
+
+  profiler_merge_nodes();
+
+  u64 total_tsc = profiler_print_header(cpu_timer_freq, csv,
+      profiler_print_tree_titles);
+  for (u32 c = s_merged_nodes[0].first_child; c;
+      c = s_merged_nodes[c].next_sibling) {
+    profiler_print_tree_node(c, 0, total_tsc, cpu_timer_freq, csv);
+  }
+
+  if (!csv) {
+    u64 not_tracked_count = 0;
+    for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+      not_tracked_count += s_threads[t].not_tracked_node_count;
+    }
+    if (not_tracked_count) {
+      fprintf(stderr, "%llu zones are not in the tree [!] "
+          "PROFILER_NODES_SIZE_MAX is %d\n",
+          not_tracked_count, PROFILER_NODES_SIZE_MAX);
+    }
+    fprintf(stderr, "%s\n\n", s_delim);
+  }
+}
+
+b32 profiler_folded_write(const char *filepath) {
+  FILE *f = fopen(filepath, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: failed to open folded stacks file '%s'",
+        filepath);
+    perror("");
+    return 0;
+  }
+
+  profiler_merge_nodes();
+  for (u32 i = 1; i < s_merged_node_count; ++i) {
+    if (s_merged_nodes[i].self_tsc) {
+      profiler_write_node_path(f, i);
+      fprintf(f, " %llu\n", s_merged_nodes[i].self_tsc);
+    }
+  }
+
+  b32 ret = !ferror(f);
+  ret &= fclose(f) == 0;
+  if (!ret) {
+    fprintf(stderr, "Error: failed to write folded stacks file '%s'\n",
+        filepath);
+  }
+  return ret;
+}
+
+void profiler_trace_begin(u64 event_count) {
+  u64 size = 1;
+  while (size < event_count) {
+    size *= 2;
+  }
+  s_trace_event_mask = size - 1;
+  s_trace_begin_tsc = read_cpu_timer();
+}
+
+// Zone names are C identifiers or short labels, only quotes and backslashes
+// need escaping
+static void profiler_trace_write_string(FILE *f, const char *s) {
+  fputc('"', f);
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') {
+      fputc('\\', f);
+    }
+    fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+// Free ring buffers of all threads and turn trace mode off
+static void profiler_trace_end(void) {
+  for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+    struct profiler_thread *thread = s_threads + t;
+    free(thread->trace_events);
+    thread->trace_events      = 0;
+    thread->trace_event_count = 0;
+    thread->trace_event_mask  = 0;
+  }
+  s_trace_event_mask = 0;
+}
+
+b32 profiler_trace_write(const char *filepath, u64 cpu_timer_freq) {
+  FILE *f = fopen(filepath, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: failed to open trace file '%s'", filepath);
+    perror("");
+    profiler_trace_end();
+    return 0;
+  }
+
+  f64 us_per_tsc = 1e6 / cpu_timer_freq;
+  u64 overwritten_count = 0;
+  const char *sep = "";
+
+  fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  for (u32 t = 0; t < PROFILER_THREADS_SIZE_MAX; ++t) {
+    struct profiler_thread *thread = s_threads + t;
+    if (atomic_load_explicit(&thread->state, memory_order_acquire)
+        == PROFILER_THREAD_STATE_UNUSED || !thread->trace_events) {
+      continue;
+    }
+
+    fprintf(f, "%s{\"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+        "\"name\": \"thread_name\", \"args\": {\"name\": ", sep, t);
+    profiler_trace_write_string(f, thread->name);
+    fprintf(f, "}}");
+    sep = ",\n";
+
+    u64 capacity = thread->trace_event_mask + 1;
+    u64 end = thread->trace_event_count;
+    u64 begin = end > capacity ? end - capacity : 0;
+    overwritten_count += begin;
+    for (u64 i = begin; i < end; ++i) {
+      struct profiler_trace_event *e =
+        thread->trace_events + (i & thread->trace_event_mask);
+      u32 index = e->elapsed_tsc_index & ((1 << PROFILER_TRACE_INDEX_BITS) - 1);
+      u64 elapsed_tsc = e->elapsed_tsc_index >> PROFILER_TRACE_INDEX_BITS;
+
+      fprintf(f, "%s{\"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"name\": ",
+          sep, t);
+      profiler_trace_write_string(f, thread->zones[index].name);
+      fprintf(f, ", \"ts\": %.3f, \"dur\": %.3f}",
+          (f64)(e->begin_tsc - s_trace_begin_tsc) * us_per_tsc,
+          (f64)elapsed_tsc * us_per_tsc);
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  b32 ret = !ferror(f);
+  ret &= fclose(f) == 0;
+  if (!ret) {
+    fprintf(stderr, "Error: failed to write trace file '%s'\n", filepath);
+  }
+  if (overwritten_count) {
+    fprintf(stderr, "Trace: %llu oldest events were overwritten, increase "
+        "ring buffer size\n", overwritten_count);
+  }
+  profiler_trace_end();
+  return ret;
+}
 #else
 int empty_translation_unit_warning_fix;
 #endif // #ifdef PROFILER_ENABLED
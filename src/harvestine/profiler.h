@@ -2,9 +2,23 @@
 
 #ifndef PROFILER_ENABLED
 
+#define PROFILER_ENABLE(level_mask)
+#define PROFILER_IS_ENABLED() (0)
+
 #define PROFILER_BEGIN()
 #define PROFILER_END()
 #define PROFILER_PRINT_STATS(cpu_timer_freq, csv)
+#define PROFILER_PRINT_THREAD_STATS(cpu_timer_freq, csv)
+#define PROFILER_PRINT_TREE(cpu_timer_freq, csv)
+#define PROFILER_FOLDED_WRITE(filepath) (1)
+
+#define PROFILER_THREAD_BEGIN(name)
+#define PROFILER_THREAD_END()
+
+#define PROFILER_TRACE_BEGIN(event_count)
+#define PROFILER_TRACE_WRITE(filepath, cpu_timer_freq) (1)
+
+#define PROFILER_PMC_BEGIN(kind_mask)
 
 #define PROFILE_FUNC_BEGIN(bytes)
 #define PROFILE_FUNC_END()
@@ -18,11 +32,15 @@
 #define PROFILE_FUNC(bytes)
 #define PROFILE_ZONE(name, bytes)
 
+#define PROFILE_FUNC_LEVEL(level, bytes)
+#define PROFILE_ZONE_LEVEL(level, name, bytes)
+
 #define PROFILER_USED_ZONE_COUNT_STATIC_ASSERT
 
 #else
 
 #include "types.h"
+#include "os.h"     // OS_PMC_COUNT
 
 #ifndef PROFILER_ZONES_SIZE_MAX
 // Zone index 0 - unused
@@ -30,10 +48,53 @@
 #define PROFILER_ZONES_SIZE_MAX   4096
 #endif // #ifndef PROFILE_ZONES_SIZE_MAX
 
+#ifndef PROFILER_LEVEL_MASK_DEFAULT
+// Zone levels enabled at start, bit `1 << level`
+#define PROFILER_LEVEL_MASK_DEFAULT 0xFFFFFFFFu
+#endif // #ifndef PROFILER_LEVEL_MASK_DEFAULT
+
+#ifndef PROFILER_NODES_SIZE_MAX
+// Call tree nodes per thread, one per distinct path of zones.
+// Node index 0 - virtual root, parent of the thread root zone
+#define PROFILER_NODES_SIZE_MAX   4096
+#endif // #ifndef PROFILER_NODES_SIZE_MAX
+
+#ifndef PROFILER_THREADS_SIZE_MAX
+// Zone tables of threads that run at the same time, including the main one
+#define PROFILER_THREADS_SIZE_MAX 16
+#endif // #ifndef PROFILER_THREADS_SIZE_MAX
+
+// Enable zones of levels in `level_mask` (bit `1 << level`) at runtime,
+// 0 disables profiler. Zones without level are level 0.
+// A disabled zone costs a test of g_profiler_level_mask and a branch at
+// begin and end. Call before PROFILER_BEGIN().
+#define PROFILER_ENABLE(level_mask)   profiler_enable(level_mask)
+#define PROFILER_IS_ENABLED()         (g_profiler_level_mask != 0)
+
 #define PROFILER_BEGIN()          profiler_begin()
 #define PROFILER_END()            profiler_end()
 #define PROFILER_PRINT_STATS(cpu_timer_freq, csv) \
   profiler_print_stats(cpu_timer_freq, csv)
+#define PROFILER_PRINT_THREAD_STATS(cpu_timer_freq, csv) \
+  profiler_print_thread_stats(cpu_timer_freq, csv)
+#define PROFILER_PRINT_TREE(cpu_timer_freq, csv) \
+  profiler_print_tree(cpu_timer_freq, csv)
+#define PROFILER_FOLDED_WRITE(filepath) profiler_folded_write(filepath)
+
+// Call at the beginning and at the end of a thread function to record its
+// zones. Zones on threads that are not registered are ignored.
+#define PROFILER_THREAD_BEGIN(name)   profiler_thread_begin(name)
+#define PROFILER_THREAD_END()         profiler_thread_end()
+
+// Record every zone into per thread ring buffers of `event_count` events and
+// write them as Chrome trace json (chrome://tracing, ui.perfetto.dev).
+#define PROFILER_TRACE_BEGIN(event_count) profiler_trace_begin(event_count)
+#define PROFILER_TRACE_WRITE(filepath, cpu_timer_freq) \
+  profiler_trace_write(filepath, cpu_timer_freq)
+
+// Record hardware counters of `kind_mask` (bit `1 << enum os_pmc` per
+// counter) in every zone, printed as IPC and miss rate columns.
+#define PROFILER_PMC_BEGIN(kind_mask) profiler_pmc_begin(kind_mask)
 
 // BEGIN/END macros
 #define PROFILE_ZONE_BEGIN(name, bytes)  PROFILE_ZONE_BEGIN_V(name, bytes, tmp_profile_zone_)
@@ -46,16 +107,22 @@
 
 // Accepts custom name for temp zone variable
 #define PROFILE_ZONE_BEGIN_V(name, bytes, var)  \
-  struct profiler_zone_mark var                 \
-    = profiler_zone_begin(__COUNTER__ + 2, name, bytes)
-#define PROFILE_ZONE_END_V(var)   profiler_zone_end(&var)
+  struct profiler_zone_mark var;                \
+  profiler_zone_begin_if_enabled(&var, 0, __COUNTER__ + 2, name, bytes)
+#define PROFILE_ZONE_END_V(var)   profiler_zone_end_if_begun(&var)
 
 // Scoped macros using gcc attribute cleanup extension
 #define PROFILE_FUNC(bytes)       PROFILE_ZONE(FUNC_NAME, bytes)
-#define PROFILE_ZONE(name, bytes)                             \
-  __attribute__((unused)) CLEANUP(cleanup_profiler_zone_end)  \
-  struct profiler_zone_mark XCONCAT(tmp_p_zone_, __LINE__)    \
-    = profiler_zone_begin(__COUNTER__ + 2, name, bytes)
+#define PROFILE_ZONE(name, bytes) PROFILE_ZONE_LEVEL(0, name, bytes)
+
+// Scoped zones recorded only if `level` is enabled
+#define PROFILE_FUNC_LEVEL(level, bytes)                          \
+  PROFILE_ZONE_LEVEL(level, FUNC_NAME, bytes)
+#define PROFILE_ZONE_LEVEL(level, name, bytes)                    \
+  __attribute__((unused)) CLEANUP(profiler_zone_end_if_begun)     \
+  struct profiler_zone_mark XCONCAT(tmp_p_zone_, __LINE__);       \
+  profiler_zone_begin_if_enabled(&XCONCAT(tmp_p_zone_, __LINE__), \
+      level, __COUNTER__ + 2, name, bytes)
 
 #define PROFILER_USED_ZONE_COUNT_STATIC_ASSERT                \
   static_assert(__COUNTER__ + 1 < PROFILER_ZONES_SIZE_MAX,    \
@@ -67,15 +134,55 @@ struct profiler_zone_mark {
   u64 prev_total_tsc;
   u32 index;
   u32 parent_index;
+  u32 node_index;             // call tree node, 0 - not tracked
   u64 bytes;
+  u64 pmc_base[OS_PMC_COUNT]; // counters at begin minus zone total
 };
 
-// Start profiling main zone
+// Enabled zone levels, bit `1 << level`, 0 - profiler is disabled.
+// Written by profiler_enable() before profiled threads start.
+extern u32 g_profiler_level_mask;
+
+void profiler_enable(u32 level_mask);
+
+// Start profiling main zone, registers calling thread as the main one.
+// Does nothing if profiler is disabled.
 void profiler_begin(void);
 
 // Finish profiling main zone
 void profiler_end(void);
 
+// Register calling thread and start its root zone `name`.
+// Every thread records zones into its own thread local table, tables are
+// merged when stats are printed. Registration takes a free table, the one
+// released by a finished thread with the same `name` is reused.
+// If all PROFILER_THREADS_SIZE_MAX tables are taken, thread is not profiled.
+// `name` should stay valid until stats are printed.
+void profiler_thread_begin(const char *name);
+
+// Finish root zone of the calling thread and release its table
+void profiler_thread_end(void);
+
+// Enable trace mode, call before profiler_begin().
+// Every thread gets a ring buffer of `event_count` (rounded up to power of
+// 2) events, allocated when the thread is registered. A zone is recorded
+// as a single event when it ends, so overhead is a few stores.
+// When a ring buffer is full, the oldest events are overwritten.
+// A thread whose ring buffer can't be allocated is not traced, with warning.
+void profiler_trace_begin(u64 event_count);
+
+// Write recorded events as Chrome trace json, tsc is converted to us with
+// `cpu_timer_freq`. Returns 0 on failure.
+// Ring buffers are freed and trace mode ends, also on failure.
+// NOTE: call after other profiled threads have been joined.
+b32 profiler_trace_write(const char *filepath, u64 cpu_timer_freq);
+
+// Enable hardware counters, call before profiler_begin().
+// Every registered thread opens its own perf counter group, counters are
+// read in user space at zone begin and end (Linux, x86_64). Counters that
+// CPU, VM or kernel (perf_event_paranoid) don't provide are left out.
+void profiler_pmc_begin(u32 kind_mask);
+
 // Start profiler zone with name, at `index` into profile zones array and
 // bytes to process
 struct profiler_zone_mark profiler_zone_begin(u32 index, const char *name,
@@ -84,14 +191,47 @@ struct profiler_zone_mark profiler_zone_begin(u32 index, const char *name,
 // End profiler zone
 void profiler_zone_end(struct profiler_zone_mark *mark);
 
-// Print profile stats to stderr
+// Print profile stats to stderr, zones of all threads are merged.
+// Root zones of threads are summed by thread name.
+// Percentages are relative to the main zone, so zones of threads running in
+// parallel can add up to more than 100%.
 // Prints in .csv format if `csv` is `true`.
 // Prints additional time in seconds if cpu_timer_freq is not zero
+// NOTE: call after other profiled threads have been joined.
 void profiler_print_stats(u64 cpu_timer_freq, b32 csv);
 
-static FORCE_INLINE void cleanup_profiler_zone_end(
+// Same as profiler_print_stats(), but zones of every thread table are
+// printed separately.
+void profiler_print_thread_stats(u64 cpu_timer_freq, b32 csv);
+
+// Print call tree to stderr: a row per path of zones with inclusive and
+// exclusive time, children are indented under parents in order of the
+// first call. Paths of all threads are merged by zone and thread names.
+// Prints in .csv format if `csv` is `true`, paths are ';' separated.
+// NOTE: call after other profiled threads have been joined.
+void profiler_print_tree(u64 cpu_timer_freq, b32 csv);
+
+// Write call tree as folded stacks (flamegraph.pl, speedscope), a line
+// `root;child;grandchild <exclusive tsc>` per path. Returns 0 on failure.
+// NOTE: call after other profiled threads have been joined.
+b32 profiler_folded_write(const char *filepath);
+
+// Disabled zone only gets index 0, the rest of the mark is not written
+static FORCE_INLINE void profiler_zone_begin_if_enabled(
+    struct profiler_zone_mark *out_mark, u32 level, u32 index,
+    const char *name, u64 bytes) {
+  if (g_profiler_level_mask & 1u << level) {
+    *out_mark = profiler_zone_begin(index, name, bytes);
+  } else {
+    out_mark->index = 0;
+  }
+}
+
+static FORCE_INLINE void profiler_zone_end_if_begun(
     struct profiler_zone_mark *mark) {
-  profiler_zone_end(mark);
+  if (mark->index) {
+    profiler_zone_end(mark);
+  }
 }
 
 #endif // #ifndef PROFILER_ENABLED
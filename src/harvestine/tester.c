@@ -6,7 +6,7 @@
 
 enum {TESTER_DEFAULT_TRY_DURATION_TSC = 240000000};
 
-static const char * const s_delim =
+static const char * const s_tester_delim =
   "--------------------------------------------------"
   "-----------------";
 
@@ -173,7 +173,7 @@ void tester_print(struct tester *tester, u64 cpu_timer_freq) {
       b32 is_csv = false;
       fprintf(stderr, "\n");
       tester_stats_print_titles(is_csv);
-      fprintf(stderr, "%s\n", s_delim);
+      fprintf(stderr, "%s\n", s_tester_delim);
       tester_stats_print(&tester->stats, cpu_timer_freq, is_csv);
       fprintf(stderr, "\n");
       break;
@@ -59,6 +59,18 @@ typedef i32                 b32;
     (b) = tmp;                \
   } while(0)
 
+#define MIN(a, b) __extension__ ({ \
+    __typeof__(a) a_ = (a);         \
+    __typeof__(b) b_ = (b);         \
+    a_ < b_ ? a_ : b_;              \
+})
+
+#define MAX(a, b) __extension__ ({ \
+    __typeof__(a) a_ = (a);         \
+    __typeof__(b) b_ = (b);         \
+    a_ > b_ ? a_ : b_;              \
+})
+
 #define CLAMP(k, l, r) __extension__ ({ \
     __typeof__(k) k_ = (k);             \
     __typeof__(l) l_ = (l);             \
@@ -9,10 +9,12 @@ OPTIONS
   -h, --help
   --sim86_decode    test 8086 instructions decode listings
   --sim86_simulate  test 8086 instructions simulate listings
+  --harvestine      test harvestine against gen_harvestine dataset
 "
 
 sim86_decode=1
 sim86_simulate=1
+harvestine=1
 
 case "$1" in
   -h | --help)
@@ -20,15 +22,23 @@ case "$1" in
     ;;
   sim86_decode)
     sim86_simulate=0
+    harvestine=0
     ;;
   sim86_simulate)
     sim86_decode=0
+    harvestine=0
+    ;;
+  harvestine)
+    sim86_decode=0
+    sim86_simulate=0
     ;;
 esac
 
-if ! command -v nasm > /dev/null; then
-    echo "Error: 'nasm' not found"
-    exit 1
+if [ $sim86_decode -gt 0 ] || [ $sim86_simulate -gt 0 ]; then
+  if ! command -v nasm > /dev/null; then
+      echo "Error: 'nasm' not found"
+      exit 1
+  fi
 fi
 
 if [ $sim86_decode -gt 0 ]; then
@@ -139,3 +149,114 @@ some of the entries in the manual look highly suspicious and are probably typos.
   done
   echo ''
 fi
+
+if [ $harvestine -gt 0 ]; then
+  echo ''
+  echo '–––––––––––––––––––––––––––––––'
+  echo 'harvestine'
+  echo '–––––––––––––––––––––––––––––––'
+  hv_dir='build/harvestine_test'
+  hv="$hv_dir/pairs"          # gen_harvestine basename
+  hv_out="$hv_dir/out.avg"
+  hv_log="$hv_dir/log.txt"
+
+  # 100k pairs is ~11 MB, more than one stream chunk
+  mkdir -p "$hv_dir" || exit 1
+  build/gen_harvestine --bin=aos 42 100000 "$hv" > /dev/null || exit 1
+  build/gen_harvestine --bin=soa 42 100000 "$hv.soa" > /dev/null || exit 1
+
+  # hv_test <expected exit code> <harvestine args...>
+  hv_test() {
+    expected="$1"
+    shift
+    echo "• harvestine $*"
+    build/harvestine --profile=off "$@" > "$hv_log" 2>&1
+    if [ $? -eq "$expected" ]; then
+      echo '  ✅ passed'
+    else
+      echo '\n––– Output –––'
+      cat "$hv_log"
+      echo '\n––– Command –––'
+      echo "build/harvestine $*"
+      echo "  ❌ failed, expected exit code $expected"
+      exit 1
+    fi
+  }
+
+  # hv_verify <in_filename> <harvestine args...>
+  hv_verify() {
+    in="$1"
+    shift
+    hv_test 0 "$@" --verify="$hv" "$in" "$hv_out"
+  }
+
+  # Input modes without --verify, average is compared with <hv>.avg
+  # hv_avg <harvestine args...>
+  hv_avg() {
+    rm -f "$hv_out"
+    hv_test 0 "$@" "$hv.json" "$hv_out"
+    awk 'NR == FNR { expected = $1; next }
+      { d = $1 - expected; exit !(d <= 1e-6 && -d <= 1e-6) }' \
+      "$hv.avg" "$hv_out" || {
+      echo "  ❌ failed, average $(cat "$hv_out") expected $(cat "$hv.avg")"
+      exit 1
+    }
+  }
+
+  for parser in baseline sentinel branchless lut; do
+    for input in fread mmap; do
+      hv_verify "$hv.json" --input=$input --parser=$parser
+    done
+  done
+  for n in 2 3 8; do
+    hv_verify "$hv.json" --threads=$n
+    hv_verify "$hv.json" --avg-threads=$n
+  done
+  for kernel in libm scalar auto; do
+    hv_verify "$hv.json" --kernel=$kernel
+    hv_verify "$hv.json" --kernel=$kernel --soa --avg-threads=3
+    hv_verify "$hv.bin" --input=bin --kernel=$kernel
+    hv_verify "$hv.soa.bin" --input=bin --kernel=$kernel --avg-threads=3
+  done
+  hv_verify "$hv.json" --emit-bin="$hv_dir/emitted.bin"
+  hv_verify "$hv_dir/emitted.bin" --input=bin
+  hv_verify "$hv.json" --soa --emit-bin="$hv_dir/emitted.soa.bin"
+  hv_verify "$hv_dir/emitted.soa.bin" --input=bin
+  # f32 error near antipodes is up to a few km, see calc_harvestine.h
+  hv_verify "$hv.json" --precision=f32 --tolerance=10
+  hv_verify "$hv.json" --precision=f32 --tolerance=10 --kernel=auto
+
+  hv_avg --input=stream
+  hv_avg --input=pipeline
+  hv_avg --fused
+  hv_avg --fused --kernel=auto
+
+  # Pairs with missing keys are read as 0, threaded parse gives the same
+  printf '{"pairs":[{}, {"x0":1}, {"y1":2.5,"x0":-3}, {}, {}, {},
+    {"x0":1,"y0":2,"x1":3,"y1":4}, {}, {"x1":80}, {}, {}]}' \
+    > "$hv_dir/missing.json"
+  hv_test 0 "$hv_dir/missing.json" "$hv_dir/missing.avg"
+  for n in 2 4; do
+    hv_test 0 --threads=$n "$hv_dir/missing.json" "$hv_out"
+    cmp "$hv_dir/missing.avg" "$hv_out" || {
+      echo "  ❌ failed, --threads=$n average differs"
+      exit 1
+    }
+  done
+
+  # Malformed json is rejected in every parser mode
+  pair_end='"y0":0,"x1":0,"y1":0}]}'
+  printf '{"pairs":[{"x0":inf,%s' "$pair_end" > "$hv_dir/inf.json"
+  printf '{"pairs":[{"x0":nan,%s' "$pair_end" > "$hv_dir/nan.json"
+  printf '{"pairs":[{"x0":+1,%s' "$pair_end" > "$hv_dir/plus.json"
+  printf '{"pairs":[{"x0":-,%s' "$pair_end" > "$hv_dir/minus.json"
+  printf '{"pairs":[{"x0":1,"y0":0,"x1":0,"z1":0}]}' > "$hv_dir/key.json"
+  printf '{"pairs":[{"x0":1,"y0":0,"x1":0,"y' > "$hv_dir/truncated.json"
+  for bad in inf nan plus minus key truncated; do
+    for mode in --parser=baseline --parser=sentinel --parser=branchless \
+        --parser=lut --threads=2 --input=stream --input=pipeline --fused; do
+      hv_test 1 $mode "$hv_dir/$bad.json" "$hv_out"
+    done
+  done
+  echo ''
+fi